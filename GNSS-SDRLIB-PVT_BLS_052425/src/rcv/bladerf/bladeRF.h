@@ -3,13 +3,15 @@
 #define BLADE_RF_H_
 
 #define BLADERF_DATABUFF_SIZE 32768
+#define BLADERF_DCAVG 0.05 /* DC offset averaging weight of new buffer */
 extern int bladerf_init(void);
 extern void bladerf_quit(void);
 extern int bladerf_initconf(void);
 extern int bladerf_start(void);
 extern int bladerf_stop(void);
-extern void calibration_dcoffset(double *inbuf, int n, int dtype, char *outbuf);
-extern void bladerf_exp(unsigned char *buf, int n, char *expbuf);
+extern void bladerf_dcreset(void);
+extern void calibration_dcoffset(const int16_t *sample, int n, int *dc);
+extern void bladerf_exp(const int16_t *sample, int n, int dtype, char *expbuf);
 extern void bladerf_getbuff(uint64_t buffloc, int n, char *expbuf);
 extern void fbladerf_pushtomembuf(void);
 
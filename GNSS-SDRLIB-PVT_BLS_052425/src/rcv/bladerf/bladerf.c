@@ -13,6 +13,12 @@ bladerf_module module;
 void **buffers;
 uint64_t count=0;
 
+/* DC offset estimate of the stream (see calibration_dcoffset) */
+static struct {
+    double off[2];   /* DC offset of I and Q (exponential average) */
+    int init;        /* estimate initialized flag */
+} dcstate;
+
 /* bladeRF stream callback  ----------------------------------------------------
 * callback for receiving RF data
 * see libbladeRF.h L854-L882
@@ -21,22 +27,18 @@ void *stream_callback(struct bladerf *dev, struct bladerf_stream *stream,
                       struct bladerf_metadata *metadata, void *samples,
                       size_t num_samples, void *user_data)
 {
-    int i,ind;
+    int ind;
     void *rv;
     int16_t *sample=(int16_t *)samples ;
 
     /* buffer index */
-    ind=(sdrstat.buffcnt%MEMBUFFLEN)*2*BLADERF_DATABUFF_SIZE;
+    ind=rcvwritebuff()*sdrini.dtype[0]*BLADERF_DATABUFF_SIZE;
 
-    mlock(hbuffmtx);
-    /* copy stream data to global buffer */
-    for (i=0;i<2*BLADERF_DATABUFF_SIZE;i++)
-        sdrstat.buff[ind+i]=(unsigned char)((sample[i]>>4)+127.5);
-    unmlock(hbuffmtx);
+    /* convert stream data to global buffer (signed samples) */
+    bladerf_exp(sample,2*BLADERF_DATABUFF_SIZE,sdrini.dtype[0],
+                (char *)&sdrstat.buff[ind]);
 
-    mlock(hreadmtx);
-    sdrstat.buffcnt++;
-    unmlock(hreadmtx);
+    rcvpushbuff();
 
     /* stop stream callback */
     if (sdrstat.stopflag) {
@@ -58,6 +60,8 @@ extern int bladerf_init(void)
     char fpga[255];
     bladerf_fpga_size s;
 
+    bladerf_dcreset();
+
     /* open bladeRF */
     ret=bladerf_open(&bladerf,NULL);
     if (ret<0) {
@@ -235,7 +239,10 @@ extern int bladerf_initconf(void)
 extern int bladerf_start(void) 
 {
     int ret;
-    
+
+    /* new stream, new DC offset estimate */
+    bladerf_dcreset();
+
     /* enable RF module */
     ret=bladerf_enable_module(bladerf,module,true);
     if (ret<0) {
@@ -273,62 +280,116 @@ extern int bladerf_stop(void)
 
     return 0;
 }
+/* reset DC-offset estimate ----------------------------------------------------
+* clear the streaming DC offset estimate (at receiver init and stream start)
+* args   : none
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void bladerf_dcreset(void)
+{
+    memset(&dcstate,0,sizeof(dcstate));
+}
 /* DC-offset calibration -------------------------------------------------------
-* calibration DC offset and I/Q imbalance
-* args   : double *buf      I   orignal RF data buffer
-*          int    n         I   number of data buffer
-*          int    dtype     I   data type (DTYPEI or DTYPEIQ)
-*          char   *outbuf   O   output data buffer
+* streaming DC offset estimation of I and Q: exponential average of the means
+* of the buffers (weight BLADERF_DCAVG of the new buffer)
+* args   : int16_t *sample  I   bladeRF raw buffer (I/Q interleaved)
+*          int    n         I   number of data (2 x number of samples)
+*          int    *dc       O   DC offset of I and Q (rounded)
 * return : none
+* notes  : one estimate for the stream, so all channels see the same offset.
+*          the estimate is reset by bladerf_dcreset
 *-----------------------------------------------------------------------------*/
-extern void calibration_dcoffset(double *inbuf, int n, int dtype, char *outbuf)
+extern void calibration_dcoffset(const int16_t *sample, int n, int *dc)
 {
-    int i;
-    double dmeanI=0,dmeanQ=0;
-
-    for (i=0;i<n;i++) {
-        if (dtype==DTYPEI) {
-            dmeanI+=inbuf[i];
-        } else if (dtype==DTYPEIQ) {
-            dmeanI+=inbuf[2*i  ];
-            dmeanQ+=inbuf[2*i+1];
-        }
+    double *dcoff=dcstate.off;
+    int32_t sum[2]={0};
+    int i=0;
+#if defined(SSE2_ENABLE)
+    __m128i x,xsumI=_mm_setzero_si128(),xsumQ=_mm_setzero_si128();
+    __m128i maskI=_mm_set1_epi32(1),maskQ=_mm_set1_epi32(1<<16);
+    int32_t s[4];
+
+    for (;i+8<=n;i+=8) {
+        x=_mm_loadu_si128((__m128i *)(sample+i));
+        xsumI=_mm_add_epi32(xsumI,_mm_madd_epi16(x,maskI));
+        xsumQ=_mm_add_epi32(xsumQ,_mm_madd_epi16(x,maskQ));
+    }
+    _mm_storeu_si128((__m128i *)s,xsumI);
+    sum[0]=s[0]+s[1]+s[2]+s[3];
+    _mm_storeu_si128((__m128i *)s,xsumQ);
+    sum[1]=s[0]+s[1]+s[2]+s[3];
+#endif
+    for (;i+2<=n;i+=2) {
+        sum[0]+=sample[i  ];
+        sum[1]+=sample[i+1];
     }
-    dmeanI/=n; dmeanQ/=n;
-
-    for (i=0;i<n;i++) {
-        if (dtype==DTYPEI) {
-            outbuf[i]=(char)(inbuf[i]-dmeanI);
-        } else if (dtype==DTYPEIQ) {
-            outbuf[2*i  ]=(char)(inbuf[2*i  ]-dmeanI);
-            outbuf[2*i+1]=(char)(inbuf[2*i+1]-dmeanQ);
+    if (n>=2) {
+        for (i=0;i<2;i++) {
+            if (!dcstate.init) dcoff[i]=(double)sum[i]/(n/2);
+            else dcoff[i]+=BLADERF_DCAVG*((double)sum[i]/(n/2)-dcoff[i]);
         }
+        dcstate.init=1;
     }
+    dc[0]=(int)floor(dcoff[0]+0.5);
+    dc[1]=(int)floor(dcoff[1]+0.5);
+}
+/* DC removed sample (saturated to int16 as _mm_subs_epi16) -----------------*/
+static int16_t subdc(int16_t s, int dc)
+{
+    int v=s-dc;
+    return (int16_t)(v<-32768?-32768:(v>32767?32767:v));
 }
 /* data expansion --------------------------------------------------------------
-* get current data buffer from memory buffer
-* args   : int16_t *buf     I   bladeRF raw buffer
-*          int    n         I   number of grab data
-*          char   *expbuf   O   extracted data buffer
+* convert bladeRF samples (SC16 Q11 I/Q) to signed samples with DC offset
+* removed (see calibration_dcoffset), done once at ingest for all channels
+* (stream_callback, fbladerf_pushtomembuf)
+* args   : int16_t *sample  I   bladeRF raw buffer (I/Q interleaved)
+*          int    n         I   number of data (2 x number of samples)
+*          int    dtype     I   data type of buffer (DTYPEIQ:8 bit>>4,
+*                               DTYPEIQ16:native 16 bit)
+*          char   *expbuf   O   extracted data buffer (n x dtype/2 bytes)
 * return : none
 *-----------------------------------------------------------------------------*/
-extern void bladerf_exp(unsigned char *buf, int n, char *expbuf)
+extern void bladerf_exp(const int16_t *sample, int n, int dtype, char *expbuf)
 {
-    int i;
-    double *dbuf;
-    unsigned char *data=buf;
+    int16_t *out=(int16_t *)expbuf;
+    int i=0,v,dc[2];
+#if defined(SSE2_ENABLE)
+    __m128i x1,x2,xdc;
+#endif
 
-    dbuf=(double*)malloc(sizeof(double)*n);
+    calibration_dcoffset(sample,n,dc);
 
-    for (i=0;i<n/2;i++) {
-        dbuf[2*i  ]=(double)(*(data+2*i  ));
-        dbuf[2*i+1]=(double)(*(data+2*i+1));
+#if defined(SSE2_ENABLE)
+    xdc=_mm_set1_epi32((int)(((uint32_t)dc[1]<<16)|((uint32_t)dc[0]&0xFFFF)));
+
+    if (dtype==DTYPEIQ16) {
+        for (;i+8<=n;i+=8) {
+            x1=_mm_subs_epi16(_mm_loadu_si128((__m128i *)(sample+i)),xdc);
+            _mm_storeu_si128((__m128i *)(out+i),x1);
+        }
+    }
+    else {
+        for (;i+16<=n;i+=16) {
+            x1=_mm_subs_epi16(_mm_loadu_si128((__m128i *)(sample+i  )),xdc);
+            x2=_mm_subs_epi16(_mm_loadu_si128((__m128i *)(sample+i+8)),xdc);
+            x1=_mm_srai_epi16(x1,4);
+            x2=_mm_srai_epi16(x2,4);
+            _mm_storeu_si128((__m128i *)(expbuf+i),_mm_packs_epi16(x1,x2));
+        }
+    }
+#endif
+    for (;i<n;i++) {
+        if (dtype==DTYPEIQ16) {
+            out[i]=subdc(sample[i],dc[i&1]);
+            continue;
+        }
+        v=subdc(sample[i],dc[i&1])>>4;
+        expbuf[i]=(char)(v<-128?-128:(v>127?127:v));
     }
-    calibration_dcoffset(dbuf,n/2,DTYPEIQ,expbuf);
-    free(dbuf);
 }
 /* get current data buffer -----------------------------------------------------
-* get current data buffer from memory buffer
+* get current data buffer from memory buffer (samples converted at ingest)
 * args   : uint64_t buffloc I   buffer location
 *          int    n         I   number of grab data
 *          char   *expbuf   O   extracted data buffer
@@ -336,19 +397,18 @@ extern void bladerf_exp(unsigned char *buf, int n, char *expbuf)
 *-----------------------------------------------------------------------------*/
 extern void bladerf_getbuff(uint64_t buffloc, int n, char *expbuf)
 {
-    uint64_t membuffloc=2*buffloc%(MEMBUFFLEN*2*BLADERF_DATABUFF_SIZE);
+    int dtype=sdrini.dtype[0];
+    uint64_t membuffloc=dtype*buffloc%(MEMBUFFLEN*dtype*BLADERF_DATABUFF_SIZE);
     int nout;
-    n=2*n;
-    nout=(int)((membuffloc+n)-(MEMBUFFLEN*2*BLADERF_DATABUFF_SIZE));
+    n=dtype*n;
+    nout=(int)((membuffloc+n)-(MEMBUFFLEN*dtype*BLADERF_DATABUFF_SIZE));
 
-    mlock(hbuffmtx);
     if (nout>0) {
-        bladerf_exp(&sdrstat.buff[membuffloc],n-nout,expbuf);
-        bladerf_exp(&sdrstat.buff[0],nout,&expbuf[n-nout]);
+        memcpy(expbuf,&sdrstat.buff[membuffloc],n-nout);
+        memcpy(&expbuf[n-nout],&sdrstat.buff[0],nout);
     } else {
-        bladerf_exp(&sdrstat.buff[membuffloc],n,expbuf);
+        memcpy(expbuf,&sdrstat.buff[membuffloc],n);
     }
-    unmlock(hbuffmtx);
 }
 /* push data to memory buffer --------------------------------------------------
 * push data to memory buffer from BladeRF binary IF file
@@ -358,28 +418,21 @@ extern void bladerf_getbuff(uint64_t buffloc, int n, char *expbuf)
 extern void fbladerf_pushtomembuf(void) 
 {
     size_t nread;
-    uint16_t buff[BLADERF_DATABUFF_SIZE*2];
-    int i,ind;
+    int16_t buff[BLADERF_DATABUFF_SIZE*2];
+    int ind;
 
-    mlock(hbuffmtx);
-
-    nread=fread(buff,sizeof(uint16_t),2*BLADERF_DATABUFF_SIZE,sdrini.fp1);
+    nread=fread(buff,sizeof(int16_t),2*BLADERF_DATABUFF_SIZE,sdrini.fp1);
     
     /* buffer index */
-    ind=(sdrstat.buffcnt%MEMBUFFLEN)*2*BLADERF_DATABUFF_SIZE;
-
-    for (i=0;i<nread;i++) {
-        sdrstat.buff[ind+i]=(uint8_t)((buff[i]>>4)+127.5);
-    }
+    ind=rcvwritebuff()*sdrini.dtype[0]*BLADERF_DATABUFF_SIZE;
 
-    unmlock(hbuffmtx);
+    /* convert to signed samples */
+    bladerf_exp(buff,(int)nread,sdrini.dtype[0],(char *)&sdrstat.buff[ind]);
 
     if (nread<2*BLADERF_DATABUFF_SIZE) {
         sdrstat.stopflag=ON;
         SDRPRINTF("end of file!\n");
     }
 
-    mlock(hreadmtx);
-    sdrstat.buffcnt++;
-    unmlock(hreadmtx);
+    rcvpushbuff();
 }
@@ -12,15 +12,11 @@ static rtlsdr_dev_t *dev=NULL;
 *-----------------------------------------------------------------------------*/
 void stream_callback_rtlsdr(unsigned char *buf, uint32_t len, void *ctx)
 {
-    /* copy stream data to global buffer */
-    mlock(hbuffmtx);
-    memcpy(&sdrstat.buff[(sdrstat.buffcnt%MEMBUFFLEN)*2*RTLSDR_DATABUFF_SIZE],
-        buf,2*RTLSDR_DATABUFF_SIZE);
-    unmlock(hbuffmtx);
+    /* convert stream data to global buffer (signed samples) */
+    rtlsdr_exp(buf,2*RTLSDR_DATABUFF_SIZE,
+        (char *)&sdrstat.buff[rcvwritebuff()*2*RTLSDR_DATABUFF_SIZE]);
 
-    mlock(hreadmtx);
-    sdrstat.buffcnt++;
-    unmlock(hreadmtx);
+    rcvpushbuff();
 
     if (sdrstat.stopflag) rtlsdr_cancel_async(dev);
 }
@@ -136,22 +132,33 @@ extern int rtlsdr_start(void)
     return 0;
 }
 /* data expansion --------------------------------------------------------------
-* get current data buffer from memory buffer
-* args   : int16_t *buf     I   bladeRF raw buffer
-*          int    n         I   number of grab data
-*          char   *expbuf   O   extracted data buffer
+* convert rtlsdr samples (unsigned offset binary) to signed samples, done once
+* at ingest for all channels (stream_callback_rtlsdr, frtlsdr_pushtomembuf)
+* args   : uint8_t *buf     I   rtlsdr raw buffer
+*          int    n         I   number of data
+*          char   *expbuf   O   extracted data buffer (may be buf)
 * return : none
+* notes  : same as (char)(buf[i]-127.5), i.e. 127 and 128 both map to 0
 *-----------------------------------------------------------------------------*/
 extern void rtlsdr_exp(uint8_t *buf, int n, char *expbuf)
 {
-    int i;
-
-    for (i=0;i<n;i++) {
+    int i=0;
+#if defined(SSE2_ENABLE)
+    __m128i x,sign=_mm_set1_epi8((char)0x80),zero=_mm_setzero_si128();
+
+    for (;i+16<=n;i+=16) {
+        /* u-128, then +1 for negative values (truncation toward zero) */
+        x=_mm_xor_si128(_mm_loadu_si128((__m128i *)(buf+i)),sign);
+        x=_mm_sub_epi8(x,_mm_cmpgt_epi8(zero,x));
+        _mm_storeu_si128((__m128i *)(expbuf+i),x);
+    }
+#endif
+    for (;i<n;i++) {
         expbuf[i]=(char)((buf[i]-127.5)); /* unsigned char to char */
     }
 }
 /* get current data buffer -----------------------------------------------------
-* get current data buffer from memory buffer
+* get current data buffer from memory buffer (samples converted at ingest)
 * args   : uint64_t buffloc I   buffer location
 *          int    n         I   number of grab data
 *          char   *expbuf   O   extracted data buffer
@@ -164,14 +171,12 @@ extern void rtlsdr_getbuff(uint64_t buffloc, int n, char *expbuf)
     n=2*n;
     nout=(int)((membuffloc+n)-(MEMBUFFLEN*2*RTLSDR_DATABUFF_SIZE));
 
-    mlock(hbuffmtx);
     if (nout>0) {
-        rtlsdr_exp(&sdrstat.buff[membuffloc],n-nout,expbuf);
-        rtlsdr_exp(&sdrstat.buff[0],nout,&expbuf[n-nout]);
+        memcpy(expbuf,&sdrstat.buff[membuffloc],n-nout);
+        memcpy(&expbuf[n-nout],&sdrstat.buff[0],nout);
     } else {
-        rtlsdr_exp(&sdrstat.buff[membuffloc],n,expbuf);
+        memcpy(expbuf,&sdrstat.buff[membuffloc],n);
     }
-    unmlock(hbuffmtx);
 }
 /* push data to memory buffer --------------------------------------------------
 * push data to memory buffer from STEREO binary IF file
@@ -181,21 +186,15 @@ extern void rtlsdr_getbuff(uint64_t buffloc, int n, char *expbuf)
 extern void frtlsdr_pushtomembuf(void) 
 {
     size_t nread;
+    uint8_t *buf=&sdrstat.buff[rcvwritebuff()*2*RTLSDR_DATABUFF_SIZE];
 
-    mlock(hbuffmtx);
-
-    nread=fread(
-        &sdrstat.buff[(sdrstat.buffcnt%MEMBUFFLEN)*2*RTLSDR_DATABUFF_SIZE],
-        1,2*RTLSDR_DATABUFF_SIZE,sdrini.fp1);
-
-    unmlock(hbuffmtx);
+    nread=fread(buf,1,2*RTLSDR_DATABUFF_SIZE,sdrini.fp1);
+    rtlsdr_exp(buf,(int)nread,(char *)buf);
 
     if (nread<2*RTLSDR_DATABUFF_SIZE) {
         sdrstat.stopflag=ON;
         SDRPRINTF("end of file!\n");
     }
 
-    mlock(hreadmtx);
-    sdrstat.buffcnt++;
-    unmlock(hreadmtx);
+    rcvpushbuff();
 }
@@ -21,15 +21,10 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <unistd.h> // needed for usleep()
+#include <sys/mman.h> // mirrored ring buffers (memfd_create, mmap)
 
-// SIMD (SSE2_ENABLE)
+// SIMD (SSE2_ENABLE: x86-64 SSE2/AVX2/AVX-512 kernels, selected at run time)
 #if defined(SSE2_ENABLE)
-  #include <emmintrin.h>
-  #include <tmmintrin.h>
-#endif
-
-// SIMD (AVX_ENABLE/AVX2_ENABLE)
-#if defined(AVX_ENABLE)||defined(AVX2_ENABLE)
   #include <immintrin.h>
 #endif
 
@@ -89,13 +84,16 @@
 #define FTYPE2        2                // front end number  
 #define DTYPEI        1                // sampling type: real  
 #define DTYPEIQ       2                // sampling type: real+imag  
+#define DTYPEIQ16     4                // sampling type: real+imag 16 bit (bladeRF SC16)  
 
 #define MEMBUFFLEN    5000             // number of temporary buffer  
 
 #define FILE_BUFFSIZE 65536            // buffer size for post processing  
 
 // acquisition setting
-#define NFFTTHREAD    4                // number of thread for executing FFT  
+#define NFFTTHREAD    1                // number of thread for executing FFT  
+                                       // (FFTs run concurrently per channel)  
+#define ACQBENCHTIME  3.0              // acquisition benchmark time per step (s)  
 #define ACQINTG_L1CA  10               // number of non-coherent integration  
 #define ACQINTG_G1    10               // number of non-coherent integration  
 #define ACQINTG_E1B   4                // number of non-coherent integration  
@@ -105,6 +103,39 @@
 #define ACQSTEP       200              // doppler search frequency step (Hz)  
 #define ACQTH         3.0              // acquisition threshold (peak ratio)  
 #define ACQSLEEP      2000             // acquisition process interval (ms)  
+#define ACQREQWAIT    100              // acquisition result polling interval (ms)  
+#define ACQCSTEP      500              // coarse search frequency step (Hz)  
+#define ACQCINTG      4                // coarse number of non-coherent integration  
+#define ACQFSTEP      100              // fine search frequency step (Hz)  
+#define ACQTHCOARSE   1.7              // coarse candidate threshold (peak ratio)  
+#define ACQNCAND      3                // max number of coarse candidates  
+#define ACQAIDNFREQ   5                // number of search frequency (aided)  
+#define ACQAIDSTEP    100              // frequency search step (aided) (Hz)  
+#define ACQAIDCHIP    3                // half width of code search (aided) (chip)  
+#define ACQAIDTH      2.5              // acquisition threshold (aided) (peak ratio)  
+#define ACQAIDAGE     30.0             // max age of aiding data (s)  
+#define MAXACQTHREAD  8                // max number of acquisition workers  
+#define ACQPRIO_NEW   0                // request priority: never acquired  
+#define ACQPRIO_VIS   1                // request priority: predicted visible  
+#define ACQPRIO_LOST  2                // request priority: recently lost  
+#define ACQPRIO_AID   3                // request priority: aided reacquisition  
+#define ACQLOSTAGE    120.0            // max time since loss of lock (LOST) (s)  
+#define ACQBACKOFF    1000             // backoff after first failed search (ms)  
+#define ACQBACKOFFMAX 60000            // max backoff after failed searches (ms)  
+#define ACQVIS_DOWN   -1               // visibility: below elevation mask  
+#define ACQVIS_UNKNOWN 0               // visibility: not predicted  
+#define ACQVIS_UP     1                // visibility: above elevation mask  
+#define ACQVISHBAND   1000.0           // half width of predicted doppler search (Hz)  
+#define ACQVISINTV    10.0             // visibility prediction interval (s)  
+#define FFTWISDOM     "./gnss-sdrcli.wisdom" // default fftw wisdom file  
+
+// SIMD kernel setting  
+#define SIMD_AUTO     -1               // SIMD kernels: best supported by cpu  
+#define SIMD_NONE     0                // SIMD kernels: none (C)  
+#define SIMD_SSE2     1                // SIMD kernels: SSE2 (SSSE3)  
+#define SIMD_AVX2     2                // SIMD kernels: AVX2 (FMA)  
+#define SIMD_AVX512   3                // SIMD kernels: AVX-512 (F/BW)  
+#define SIMDENV       "GNSS_SDR_SIMD"  // SIMD kernels override (environment)  
 
 // tracking setting  
 #define LOOP_L1CA     10               // loop interval  
@@ -135,8 +166,18 @@
 // observation data generation  
 #define PTIMING       68.802           // pseudo range generation timing (ms)  
 #define OBSINTERPN    80               // # of obs. stock for interpolation  
+#define OBSHIST(h,x,k) ((h)->x[((h)->obsi+(k))%OBSINTERPN]) // k-th latest obs. (hist ring)  
+#define SNRHIST(h,x,k) ((h)->x[((h)->snri+(k))%OBSINTERPN]) // k-th latest SNR (hist ring)  
 #define SNSMOOTHMS    100              // SNR smoothing interval (ms)  
 
+// tracking correlator and scratch buffers  
+#define MAXCORRN      16               // max number of correlation points  
+#define SDRALIGN      64               // memory alignment (cache line) (byte)  
+#define SDRCACHE      __attribute__((aligned(SDRALIGN))) // start on own cache line  
+#define TRKSTRETCH    0.001            // max code doppler stretch of one code  
+#define MAXCBPHASE    256              // max code replica bank phases per sample  
+#define TRKCBDRIFT    0.1              // max code replica drift in a block (sample)  
+
 // code generation parameter  
 #define MAXGPSSATNO   210              // max satellite number  
 #define MAXGALSATNO   50               // max satellite number  
@@ -164,7 +205,30 @@
 #define SNR_RESET_THRES		15  	// Threshold to reset sdrch channel
 #define SNR_PVT_THRES 		19      // Threshold to use obs for PVT
 
-// The sdrthread function uses this as a check to make sure GPS week
+// channel workers
+#define MAXWORKER     16               // max number of channel worker threads  
+#define SDRSTEP_IDLE  0                // channel step: nothing to do (no data)  
+#define SDRSTEP_RUN   1                // channel step: acquisition or tracking run  
+#define CHRESETWAIT   10000            // reacquisition delay after reset (ms)  
+#define OVRTESTWAIT   10.0             // overrun test: tracking before stall (s)  
+#define WORKSTEAL     5                // steal from a worker busy for (ms)  
+#define SAMPWAIT      100              // max wait for new samples/obs (ms)  
+
+// load shedding (see shedthread)
+#define SHED_NONE     0                // shed: channel not shed  
+#define SHED_ACQ      1                // shed: acquisition suspended  
+#define SHED_DROP     2                // shed: tracking dropped  
+#define SHEDINTV      500              // shedding supervisor interval (ms)  
+#define SHEDWAIT      1000             // shed channel step interval (ms)  
+#define SHEDSETTLE    2000             // min time between shedding steps (ms)  
+#define SHEDHYST      10.0             // cpu hysteresis of restoring (%)  
+#define SHEDLAG       200.0            // default max tracking lag (ms)  
+#define SHEDCPU       90.0             // default max cpu load (%)  
+#define SHEDHOLD      10.0             // default headroom time to restore (s)  
+#define SHEDMINCH     8                // default min tracked channels  
+#define SHEDOUTMS     1000             // default PVT interval when shed (ms)  
+
+// The sdrchstep function uses this as a check to make sure GPS week
 // is non-zero, so just needs to be about right. Might automate this
 // at some point.
 #define GPS_WEEK      2360
@@ -197,6 +261,11 @@
 #define setevent(f)   pthread_cond_signal(&f)
 #define waitevent(f,m) pthread_cond_wait(&f,&m)
 #define delevent(f)   pthread_cond_destroy(&f)
+#define bcastevent(f) pthread_cond_broadcast(&f)
+#define timedwaitevent(f,m,t) pthread_cond_timedwait(&f,&m,t)
+#define atomget(v)    __atomic_load_n(&(v),__ATOMIC_SEQ_CST)
+#define atomset(v,x)  __atomic_store_n(&(v),x,__ATOMIC_SEQ_CST)
+#define atomadd(v,x)  __atomic_add_fetch(&(v),x,__ATOMIC_SEQ_CST)
 #define waitthread(f) pthread_join(f,NULL)
 #define cratethread(f,func,arg) pthread_create(&f,NULL,func,arg)
 #define THRETVAL      NULL
@@ -213,7 +282,7 @@ typedef struct {
         double f_cf[2];  // center frequency (Hz)  
         double f_sf[2];  // sampling frequency (Hz)  
         double f_if[2];  // intermediate frequency (Hz)  
-        int dtype[2];    // data type (DTYPEI/DTYPEIQ)  
+        int dtype[2];    // data type (DTYPEI/DTYPEIQ/DTYPEIQ16)  
         FILE *fp1;       // IF1 file pointer  
         FILE *fp2;       // IF2 file pointer  
         char file1[1024]; // IF1 file path  
@@ -246,8 +315,38 @@ typedef struct {
         double trkfllb[2]; // fll noise bandwidth (Hz)  
         int rtlsdrppmerr; // clock collection for RTL-SDR  
         int ekfFilterOn;  // flag to run EKF (rather than BLS)
+        int acqbatch;    // batched multi-PRN acquisition flag  
+        int acqnthr;     // number of acquisition workers (0: per channel)  
+        int acqfd;       // frequency domain doppler search flag  
+        int acq2step;    // two-stage (coarse-to-fine) acquisition flag  
+        int acqaid;      // aided reacquisition flag  
+        int acqvis;      // almanac visibility prediction flag  
+        double acqcstep; // coarse search frequency step (Hz)  
+        int acqcintg;    // coarse number of integration  
+        double acqfstep; // fine search frequency step (Hz)  
+        int fftplanner;  // fftw planner (0:estimate,1:measure,2:patient)  
+        char fftwisdom[1024]; // fftw wisdom file path  
+        int simd;        // SIMD kernels (SIMD_AUTO,SIMD_NONE,SIMD_SSE2,...)  
+        int trkcbank;    // code replica bank phases per sample (0:rescode)  
+        int nworker;     // number of channel worker threads  
+        double trkcbdrift; // max code replica drift in a block (sample)  
+        int shed;        // adaptive load shedding flag  
+        double shedlag;  // shed above tracking lag (ms)  
+        double shedcpu;  // shed above cpu load of real-time cpus (%)  
+        double shedhold; // headroom time before restoring a level (s)  
+        int shedminch;   // tracked channels kept (best C/N0)  
+        int shedoutms;   // PVT output interval when shed (ms)  
 } sdrini_t;
 
+// sdr almanac struct  
+typedef struct {
+        int flag;        // almanac valid flag  
+        int svh;         // sv health  
+        double toas;     // time of almanac (s)  
+        double A,e,i0,OMG0,omg,M0,OMGd; // orbit parameters  
+        double f0,f1;    // sv clock parameters (af0,af1)  
+} sdralm_t;
+
 // sdr current state struct  
 typedef struct {
         int stopflag;    // stop flag  
@@ -258,7 +357,12 @@ typedef struct {
         unsigned char *buff; // IF data buffer  
         unsigned char *buff2;// IF data buffer (for file input)  
         unsigned char *tmpbuff; // USB temporary buffer (for STEREO_V26)  
-        uint64_t buffcnt; // current buffer location  
+        size_t ringsize; // buff is mirrored ring of this size (0: malloc)  
+        size_t ringsize2; // buff2 is mirrored ring of this size (0: malloc)  
+        uint64_t buffcnt; // published buffer count (atomic, see rcvpushbuff)  
+        uint64_t wrtcnt; // buffer count incl. one being written (rcvwritebuff)  
+        int nwait;       // number of threads in rcvwaitbuff (atomic)  
+        uint64_t obscnt; // observation data update counter (see syncthread)  
         int printflag; // DK added, flag for printing obs and nav file
         double lat;
         double lon;
@@ -275,6 +379,7 @@ typedef struct {
         double xyzdt[4];
         double elapsedTime;
         int azElCalculatedflag;
+        sdralm_t alm[MAXSAT]; // GPS almanac (subframe 4/5)
 } sdrstat_t;
 
 // sdr observation struct  
@@ -289,6 +394,15 @@ typedef struct {
         double S;        // SNR (dB-Hz)  
 } sdrobs_t;
 
+// sdr acquisition aiding struct (last good tracking state)  
+typedef struct {
+        int flag;        // aiding data valid flag  
+        uint64_t buffloc; // buffer location at top of code  
+        double carrfreq; // carrier frequency (Hz)  
+        double codefreq; // code frequency (Hz)  
+        double age;      // max age of aiding data (s) (0: ACQAIDAGE)  
+} sdracqaid_t;
+
 // sdr acquisition struct  
 typedef struct {
         int intg;        // number of integration  
@@ -302,6 +416,22 @@ typedef struct {
         int nfft;        // number of FFT points  
         double cn0;      // signal C/N0  
         double peakr;    // first/second peak ratio  
+        int flagreq;     // acquisition request flag (batched acquisition)  
+        int flagres;     // acquisition result flag (batched acquisition)  
+        uint64_t buffloc; // buffer location at top of code (batched acq.)  
+        int flagbusy;    // request taken by acquisition worker  
+        int prio;        // request priority (ACQPRIO_???)  
+        int nfail;       // number of consecutive failed searches  
+        unsigned long treq; // request time (ms)  
+        unsigned long tnext; // earliest time of next search (backoff) (ms)  
+        int fintg;       // number of integration (fine search)  
+        double fstep;    // frequency search step (fine search) (Hz)  
+        int nffreq;      // number of search frequency (fine search)  
+        double *ffreq;   // search frequency (fine search) (Hz)  
+        sdracqaid_t aid; // aiding data for reacquisition (kept over reset)  
+        int vis;         // predicted visibility (ACQVIS_???)  
+        double visel;    // predicted elevation (deg)  
+        double visfreq;  // predicted carrier frequency (Hz)  
 } sdracq_t;
 
 // sdr tracking parameter struct  
@@ -317,8 +447,10 @@ typedef struct {
 } sdrtrkprm_t;
 
 // sdr tracking struct  
+// (loop state written by the owning channel every code period, observation
+// history is kept apart in sdrtrkhist_t)  
 typedef struct {
-        double codefreq; // code frequency (Hz)  
+        double codefreq SDRCACHE; // code frequency (Hz)  
         double carrfreq; // carrier frequency (Hz)  
         double remcode;  // remained code phase (chip)  
         double remcarr;  // remained carrier phase (rad)  
@@ -330,22 +462,6 @@ typedef struct {
         double carrErr;  // carrier tracking error  
         double freqErr;  // frequencyr error in FLL  
         uint64_t buffloc; // current buffer location  
-        double tow[OBSINTERPN]; // time of week (s)  
-        uint64_t codei[OBSINTERPN]; // code phase (sample)  
-        uint64_t codeisum[OBSINTERPN]; // code phase for SNR computation (sample)  
-        uint64_t cntout[OBSINTERPN]; // loop counter  
-        double remcout[OBSINTERPN]; // remained code phase (chip) 
-        double L[OBSINTERPN];// carrier phase (cycle)  
-        double D[OBSINTERPN];// doppler frequency (Hz)  
-        double S[OBSINTERPN];// signal to noise ratio (dB-Hz)  
-        double *II;      // correlation (in-phase)  
-        double *QQ;      // correlation (quadrature-phase)  
-        double *oldI;    // previous correlation (I-phase)  
-        double *oldQ;    // previous correlation (Q-phase)  
-        double *sumI;    // integrated correlation (I-phase)  
-        double *sumQ;    // integrated correlation (Q-phase)  
-        double *oldsumI; // previous integrated correlation (I-phase)  
-        double *oldsumQ; // previous integrated correlation (Q-phase)  
         double Isum;     // correlation for SNR computation (I-phase)  
         int loop;        // loop filter interval  
         int loopms;      // loop filter interval (ms)  
@@ -353,13 +469,60 @@ typedef struct {
         int flagremcarradd; // remained carrier phase add flag  
         int flagloopfilter; // loop filter update flag  
         int corrn;       // number of correlation points  
+        int ne,nl;       // early/late correlation point  
         int *corrp;      // correlation points (sample)  
+        double *II;      // correlation (in-phase)  
+        double *QQ;      // correlation (quadrature-phase)  
+        double *oldI;    // previous correlation (I-phase)  
+        double *oldQ;    // previous correlation (Q-phase)  
+        double *sumI;    // integrated correlation (I-phase)  
+        double *sumQ;    // integrated correlation (Q-phase)  
+        double *oldsumI; // previous integrated correlation (I-phase)  
+        double *oldsumQ; // previous integrated correlation (Q-phase)  
         double *corrx;   // correlation points (for plotting)  
-        int ne,nl;       // early/late correlation point  
         sdrtrkprm_t prm1; // tracking parameter struct  
         sdrtrkprm_t prm2; // tracking parameter struct  
 } sdrtrk_t;
 
+// sdr tracking observation history struct  
+// (rings pushed every loop filter update, read by syncthread)  
+typedef struct {
+        int obsi;        // head of obs. history ring (index of latest, OBSHIST)  
+        int snri;        // head of SNR history ring (index of latest, SNRHIST)  
+        double tow[OBSINTERPN]; // time of week (s)  
+        uint64_t codei[OBSINTERPN]; // code phase (sample)  
+        uint64_t codeisum[OBSINTERPN]; // code phase for SNR computation (sample)  
+        uint64_t cntout[OBSINTERPN]; // loop counter  
+        double remcout[OBSINTERPN]; // remained code phase (chip) 
+        double L[OBSINTERPN];// carrier phase (cycle)  
+        double D[OBSINTERPN];// doppler frequency (Hz)  
+        double S[OBSINTERPN];// signal to noise ratio (dB-Hz)  
+} sdrtrkhist_t;
+
+// sdr tracking scratch buffer struct  
+typedef struct {
+        int nmax;        // max number of samples in one code  
+        int smax;        // max correlator space (sample)  
+        char *data;      // sampling data ((nmax+100) x dtype)  
+        short *dataI;    // carrier mixed data (I-phase) (nmax+64)  
+        short *dataQ;    // carrier mixed data (Q-phase) (nmax+64)  
+        short *code;     // resampled code (nmax+2*smax+64)  
+        unsigned long nalloc; // sdrmalloc/cpxmalloc calls in tracking epochs  
+} sdrtrkbuf_t;
+
+// sdr code replica bank struct  
+typedef struct {
+        int nph;         // number of fractional phases per sample (0:no bank)  
+        int len;         // length of one replica (sample)  
+        int smax;        // max correlator space (sample)  
+        int clen;        // code length (chip)  
+        double ci;       // nominal code sampling interval (chip)  
+        double drift;    // max code drift in a block (sample)  
+        short *code;     // replicas (nph x len)  
+        unsigned long nuse; // number of blocks from the bank  
+        unsigned long nfall; // number of blocks resampled (rescode)  
+} sdrcbank_t;
+
 // sdr ephemeris struct  
 typedef struct {
         eph_t eph;       // GPS/QZS/GAL/COM ephemeris struct (from rtklib.h)  
@@ -398,7 +561,8 @@ typedef struct {
         int biti;        // current navigation bit index  
         int cnt;         // navigation bit counter for synchronization  
         double bitIP;    // current navigation bit (IP data)  
-        int *fbits;      // frame bits  
+        int *fbits;      // frame bits (ring, oldest bit at fbitsi)  
+        int fbitsi;      // head of frame bits ring (index of oldest bit)  
         int *fbitsdec;   // decoded frame bits  
         int update;      // decode interval (ms)  
         int *bitsync;    // frame bits synchronization count  
@@ -422,10 +586,44 @@ typedef struct {
         sdrsbas_t sbas;  // SBAS message struct  
 } sdrnav_t;
 
+// sdr channel task struct (state kept between channel steps)  
+typedef struct {
+        uint64_t buffloc; // buffer location of next code (sample)  
+        uint64_t bufflocnow; // latest buffer location (sample)  
+        uint64_t cnt;    // tracking loop counter  
+        uint64_t loopcnt; // loop filter counter  
+        float *acqpower; // acquisition power (channel acquisition)  
+        time_t tacq;     // time of acquisition  
+        double elapsed;  // elapsed time since acquisition (s)  
+        unsigned long tnext; // next step not before (ms, see sdrdefer)  
+        uint64_t need;   // buffer count needed by next step (0: none)  
+        uint64_t lag;    // tracking lag behind the grabber (sample)  
+        double lagms;    // tracking lag behind the grabber (ms)  
+        double lagmax;   // max tracking lag (ms)  
+        int overrun;     // samples of last step overwritten in the ring  
+        unsigned long noverrun; // number of ring overruns (reacquisitions)  
+        int lostlock;    // code period of last step exceeds scratch buffers  
+        unsigned long nresync; // number of resyncs after ring overruns  
+        unsigned long naided; // number of aided reacquisitions  
+        int shed;        // load shedding state (SHED_???, see shedthread)  
+} sdrtask_t;
+
 // sdr channel struct  
+// (state touched every code period first and contiguous, then observation
+// history and configuration, each on own cache lines so that a channel step
+// does not invalidate the lines of its neighbours read by other threads)  
 typedef struct {
-        thread_t hsdr;   // thread handle  
-        int no;          // channel number  
+        sdrtask_t task SDRCACHE; // channel task struct (kept over reset)  
+        sdrtrk_t trk;    // tracking struct  
+        sdrtrkbuf_t buf; // tracking scratch buffer struct  
+        sdrcbank_t cbank; // code replica bank struct  
+        int flagacq;     // acquisition flag  
+        int flagtrk;     // tracking flag  
+        int currnsamp;   // current number of samples in one code  
+        double elapsed_time_snr;
+        double elapsed_time_nav;
+        sdrtrkhist_t hist SDRCACHE; // tracking observation history struct  
+        int no SDRCACHE; // channel number  
         int sat;         // satellite number  
         int sys;         // satellite system  
         int prn;         // PRN  
@@ -448,15 +646,9 @@ typedef struct {
         double ti;       // sampling interval (s)  
         double ci;       // chip interval (s)  
         int nsamp;       // number of samples in one code (doppler=0Hz)  
-        int currnsamp;   // current number of samples in one code  
         int nsampchip;   // number of samples in one code chip (doppler=0Hz)  
         sdracq_t acq;    // acquisition struct  
-        sdrtrk_t trk;    // tracking struct  
         sdrnav_t nav;    // navigation struct  
-        int flagacq;     // acquisition flag  
-        int flagtrk;     // tracking flag  
-        double elapsed_time_snr;
-        double elapsed_time_nav;
 } sdrch_t;
 
 // EKF struct
@@ -471,6 +663,30 @@ typedef struct {
   char *messages[100];
 } sdrgui_t;
 
+// load shedding supervisor struct  
+typedef struct {
+        int level;       // shedding level (0:none,1:acq,2:channels,3:PVT rate)  
+        int maxlevel;    // max shedding level  
+        int ndrop;       // number of dropped tracking channels  
+        int outms;       // current PVT output interval (ms)  
+        double cpu;      // cpu load of real-time cpus (%)  
+        double lagmax;   // max lag of tracking channels (ms)  
+} sdrshed_t;
+
+// sdr channel worker struct (deque of channel tasks)  
+typedef struct {
+        thread_t hthr;   // thread handle  
+        int no;          // worker number  
+        int cpu;         // pinned cpu (-1: not pinned)  
+        mlock_t hmtx;    // deque mutex  
+        int ch[MAXSAT];  // channel indexes (ring)  
+        int head;        // first task in deque  
+        int n;           // number of tasks in deque  
+        unsigned long tbusy; // start of running step (ms) (0: not running)  
+        unsigned long nstep; // number of channel steps  
+        unsigned long nsteal; // number of stolen tasks  
+} sdrworker_t;
+
 // global variables -----------------------------------------------------------
 extern thread_t hmainthread;  // main thread handle  
 extern thread_t hsyncthread;  // synchronization thread handle  
@@ -478,25 +694,34 @@ extern thread_t hkeythread;   // keyboard thread handle
 extern thread_t hdatathread;   // keyboard thread handle  
 extern thread_t hserverthread;   // server thread  
 extern thread_t hmsgthread;   // GUI messages thread  
+extern thread_t hacqthread[MAXACQTHREAD]; // acquisition worker handles  
+extern thread_t hshedthread;  // load shedding supervisor handle  
 
-extern mlock_t hbuffmtx;      // buffer access mutex  
-extern mlock_t hreadmtx;      // buffloc access mutex  
-extern mlock_t hfftmtx;       // fft function mutex  
+extern mlock_t hreadmtx;      // new samples event mutex  
+extern mlock_t hfftmtx;       // fft plan creation mutex  
 extern mlock_t hobsmtx;       // observation data access mutex  
 extern mlock_t hresetmtx;     // sdr channel reset flag mutex  
 extern mlock_t hobsvecmtx;    // observation vector access mutex  
 extern mlock_t hmsgmtx;       // messages access mutex  
+extern mlock_t hacqmtx;       // acquisition request/result mutex  
+extern event_t hreadevent;    // new samples event (with hreadmtx)  
+extern event_t hobsevent;     // observation data event (with hobsmtx)  
 
 extern sdrini_t sdrini;       // sdr initialization struct  
 extern sdrstat_t sdrstat;     // sdr state struct  
 extern sdrch_t sdrch[MAXSAT]; // sdr channel structs  
 extern sdrekf_t sdrekf;       // sdr EKF struct
 extern sdrgui_t sdrgui;       // GUI
+extern sdrworker_t sdrworker[MAXWORKER]; // channel workers  
+extern sdrshed_t sdrshed;     // load shedding supervisor  
 
 // sdrmain.c ------------------------------------------------------------------
 extern void startsdr(void);
 extern void quitsdr(sdrini_t *ini, int stop);
-extern void *sdrthread(void *arg);
+extern void sdrdefer(sdrch_t *sdr, int ms);
+extern int sdrchstep(sdrch_t *sdr);
+extern void sdrchfinish(sdrch_t *sdr);
+extern void *sdrworkthread(void *arg);
 extern void *datathread(void *arg);
 extern int resetStructs(void *arg);
 extern int checkObsDelay(int prn);
@@ -504,9 +729,20 @@ extern int checkObsDelay(int prn);
 // sdrsync.c ------------------------------------------------------------------
 extern void *syncthread(void * arg);
 
+// sdrshed.c ------------------------------------------------------------------
+extern void *shedthread(void *arg);
+
 // sdracq.c -------------------------------------------------------------------
-extern uint64_t sdraqcuisition(sdrch_t *sdr, double *power);
-extern int checkacquisition(double *P, sdrch_t *sdr);
+extern uint64_t sdraqcuisition(sdrch_t *sdr, float *power);
+extern int checkacquisition(float *P, sdrch_t *sdr);
+extern int sdracqfine(sdrch_t *sdr, const float *P, float *power,
+                      uint64_t *buffloc);
+extern uint64_t sdracqaided(sdrch_t *sdr);
+extern uint64_t sdracqrequest(sdrch_t *sdr);
+extern void sdracqgrid(sdrch_t *sdr);
+extern int sdracqbatch(sdrch_t **sdr, int n);
+extern void *acqthread(void *arg);
+extern int acqbench(int maxthread);
 
 // sdrtrk.c -------------------------------------------------------------------
 extern uint64_t sdrtracking(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt);
@@ -516,6 +752,7 @@ extern void pll(sdrch_t *sdr, sdrtrkprm_t *prm, double dt);
 extern void dll(sdrch_t *sdr, sdrtrkprm_t *prm, double dt);
 extern void setobsdata(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt,
                        sdrtrk_t *trk, int flag);
+extern uint64_t trkresync(sdrch_t *sdr, uint64_t buffloc, uint64_t *cnt);
 
 // sdrinit.c ------------------------------------------------------------------
 extern int readinifile(sdrini_t *ini);
@@ -541,8 +778,14 @@ extern double log2(double n);
 extern int calcfftnum(double x, int next);
 extern void *sdrmalloc(size_t size);
 extern void sdrfree(void *p);
+extern void *ringalloc(size_t size);
+extern void ringfree(void *p, size_t size);
+extern unsigned long sdrnalloc(void);
 extern cpx_t *cpxmalloc(int n);
 extern void cpxfree(cpx_t *cpx);
+extern void fftinit(const char *wisdom, int planner);
+extern void fftquit(void);
+extern fftwf_plan fftplan(int n, int sign, cpx_t *cpx);
 extern void cpxfft(fftwf_plan plan, cpx_t *cpx, int n);
 extern void cpxifft(fftwf_plan plan, cpx_t *cpx, int n);
 extern void cpxcpx(const short *II, const short *QQ, double scale, int n,
@@ -550,7 +793,10 @@ extern void cpxcpx(const short *II, const short *QQ, double scale, int n,
 extern void cpxcpxf(const float *II, const float *QQ, double scale,  int n,
                     cpx_t *cpx);
 extern void cpxconv(fftwf_plan plan, fftwf_plan iplan, cpx_t *cpxa, cpx_t *cpxb,
-                    int m, int n, int flagsum, double *conv);
+                    int m, int n, int flagsum, float *conv);
+extern void cpxconvx(fftwf_plan iplan, const cpx_t *cpxa, int shift,
+                     const cpx_t *cpxb, int m, int n, int flagsum, cpx_t *work,
+                     float *conv);
 extern void cpxpspec(fftwf_plan plan, cpx_t *cpx, int n, int flagsum,
                      double *pspec);
 extern void dot_21(const short *a1, const short *a2, const short *b, int n,
@@ -568,6 +814,7 @@ extern void sumvd(const double *data1, const double *data2, int n, double *out);
 extern int maxvi(const int *data, int n, int exinds, int exinde, int *ind);
 extern float maxvf(const float *data, int n, int exinds, int exinde, int *ind);
 extern double maxvd(const double *data, int n, int exinds, int exinde,int *ind);
+extern float meanvf(const float *data, int n, int exinds, int exinde);
 extern double meanvd(const double *data, int n, int exinds, int exinde);
 extern double interp1(double *x, double *y, int n, double t);
 extern void uint64todouble(uint64_t *data, uint64_t base, int n, double *out);
@@ -575,13 +822,25 @@ extern void ind2sub(int ind, int nx, int ny, int *subx, int *suby);
 extern void shiftdata(void *dst, void *src, size_t size, int n);
 extern double rescode(const short *code, int len, double coff, int smax,
                       double ci, int n, short *rcode);
+extern int gencodebank(const short *code, int len, double ci, int smax,
+                       int nph, double drift, sdrcbank_t *bank);
+extern void freecodebank(sdrcbank_t *bank);
+extern void pcorrspec(const char *data, int dtype, double ti, int m,
+                      double freq, short *II, short *QQ, cpx_t *datax);
+extern int pcorrbins(const double *freq, int nfreq, double ti, int m,
+                     int flagfd, double *fres, int *shift, int *resi);
 extern void pcorrelator(const char *data, int dtype, double ti, int n,
                         double *freq, int nfreq, double crate, int m,
-                        cpx_t* codex, double *P);
+                        cpx_t* codex, int flagfd, float *P);
 extern void correlator(const char *data, int dtype, double ti, int n,
                        double freq, double phi0, double crate, double coff,
                        int* s, int ns, double *II, double *QQ, double *remc,
-                       double *remp, short* codein, int coden);
+                       double *remp, short* codein, int coden,
+                       short *dataI, short *dataQ, short *code_e,
+                       sdrcbank_t *bank);
+extern const char *simdname(int simd);
+extern int simdcode(const char *str);
+extern int simdinit(int simd);
 extern int leap_seconds(long gps_seconds);
 extern time_t gps_to_utc(int gps_week, double gps_tow);
 
@@ -606,6 +865,7 @@ extern int togeod(double a, double finv, double X, double Y, double Z,
                   double *dphi, double *dlambda, double *h);
 extern int topocent(double X[], double dx[], double *Az, double *El, double *D);
 extern int updateObsList(void);
+extern int visPredict(double tow);
 
 // sdrekf.c -------------------------------------------------------------------
 
@@ -644,6 +904,13 @@ extern int rcvgrabstart(sdrini_t *ini);
 extern int rcvgrabdata(sdrini_t *ini);
 extern int rcvgetbuff(sdrini_t *ini, uint64_t buffloc, int n, int ftype,
                       int dtype, char *expbuf);
+extern int rcvwritebuff(void);
+extern void rcvpushbuff(void);
+extern uint64_t rcvbuffcnt(void);
+extern int rcvcheckbuff(uint64_t buffloc);
+extern const char *rcvviewbuff(sdrini_t *ini, uint64_t buffloc, int n,
+                               int ftype, int dtype);
+extern int rcvwaitbuff(uint64_t cnt, int ms);
 extern void file_pushtomembuf(void);
 extern void file_getbuff(uint64_t buffloc, int n, int ftype, int dtype,
                          char *expbuf);
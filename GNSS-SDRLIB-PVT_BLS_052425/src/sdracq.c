@@ -7,12 +7,12 @@
 #include "sdr.h"
 
 /* sdr acquisition function ----------------------------------------------------
-* sdr acquisition function called from sdr channel thread
+* sdr acquisition function called from the channel step (sdrchstep)
 * args   : sdrch_t *sdr     I/O sdr channel struct
-*          double *power    O   normalized correlation power vector (2D array)
+*          float  *power    O   normalized correlation power vector (2D array)
 * return : uint64_t             current buffer location
 *-----------------------------------------------------------------------------*/
-extern uint64_t sdraqcuisition(sdrch_t *sdr, double *power)
+extern uint64_t sdraqcuisition(sdrch_t *sdr, float *power)
 {
     int i;
     char *data;
@@ -22,9 +22,7 @@ extern uint64_t sdraqcuisition(sdrch_t *sdr, double *power)
     data=(char*)sdrmalloc(sizeof(char)*2*sdr->nsamp*sdr->dtype);
 
     /* current buffer location */
-    mlock(hreadmtx);
-    buffloc=(sdrstat.fendbuffsize*sdrstat.buffcnt)-(sdr->acq.intg+1)*sdr->nsamp;
-    unmlock(hreadmtx);
+    buffloc=(sdrstat.fendbuffsize*rcvbuffcnt())-(sdr->acq.intg+1)*sdr->nsamp;
 
     /* acquisition integration */
     for (i=0;i<sdr->acq.intg;i++) {
@@ -44,14 +42,19 @@ extern uint64_t sdraqcuisition(sdrch_t *sdr, double *power)
 
         /* fft correlation */
         pcorrelator(data,sdr->dtype,sdr->ti,sdr->nsamp,sdr->acq.freq,
-            sdr->acq.nfreq,sdr->crate,sdr->acq.nfft,sdr->xcode,power);
+            sdr->acq.nfreq,sdr->crate,sdr->acq.nfft,sdr->xcode,sdrini.acqfd,
+            power);
 
-        /* check acquisition result */
-        if (checkacquisition(power,sdr)) {
+        /* check acquisition result (coarse search: after integration) */
+        if (!sdrini.acq2step&&checkacquisition(power,sdr)) {
             sdr->flagacq=ON;
             break;
         }
     }
+    /* fine search around coarse candidates */
+    if (sdrini.acq2step) {
+        sdr->flagacq=sdracqfine(sdr,power,power,&buffloc);
+    }
 
     // Display acquisition results
     /*
@@ -65,46 +68,665 @@ extern uint64_t sdraqcuisition(sdrch_t *sdr, double *power)
     // Set acquisition result
     if (sdr->flagacq) {
         /* set buffer location at top of code */
-        buffloc+=-(i+1)*sdr->nsamp+sdr->acq.acqcodei;
+        if (!sdrini.acq2step) buffloc+=-(i+1)*sdr->nsamp+sdr->acq.acqcodei;
         sdr->trk.carrfreq=sdr->acq.acqfreq;
         sdr->trk.codefreq=sdr->crate;
     }
     else {
-        sleepms(ACQSLEEP);
+        sdrdefer(sdr,ACQSLEEP);
     }
     sdrfree(data);
     return buffloc;
 }
-/* check acquisition result ----------------------------------------------------
-* check GNSS signal exists or not
-* carrier frequency is computed
-* args   : sdrch_t *sdr     I/0 sdr channel struct
-*          double *P        I   normalized correlation power vector
-* return : int                  acquisition flag (0: not acquired, 1: acquired) 
-* note : first/second peak ratio and c/n0 computation
+/* check correlation peak ------------------------------------------------------
+* compute code phase, doppler, c/n0 and peak ratio of correlation peak
+* args   : float  *P        I   normalized correlation power vector
+*          double *freq     I   search frequencies of P (Hz)
+*          int    nfreq     I   number of search frequencies
+*          int    codec     I   center of code phase window (samples)
+*          int    win       I   half width of code phase window (samples)
+*                               (win<0: search all code phases)
+*          sdrch_t *sdr     I/0 sdr channel struct
+* return : double               first/second peak ratio
 *-----------------------------------------------------------------------------*/
-extern int checkacquisition(double *P, sdrch_t *sdr)
+static double checkpeak(const float *P, const double *freq, int nfreq,
+                        int codec, int win, sdrch_t *sdr)
 {
-    int maxi,codei,freqi,exinds,exinde;
+    int i,j,k,maxi,codei=0,freqi=0,exinds,exinde;
     double maxP,maxP2,meanP;
 
-    maxP=maxvd(P,sdr->nsamp*sdr->acq.nfreq,-1,-1,&maxi);
-    ind2sub(maxi,sdr->nsamp,sdr->acq.nfreq,&codei,&freqi);
+    if (win<0) {
+        maxP=maxvf(P,sdr->nsamp*nfreq,-1,-1,&maxi);
+        ind2sub(maxi,sdr->nsamp,nfreq,&codei,&freqi);
+    }
+    else {
+        /* peak within code phase window */
+        for (j=0,maxP=-1.0;j<nfreq;j++) {
+            for (k=-win;k<=win;k++) {
+                i=((codec+k)%sdr->nsamp+sdr->nsamp)%sdr->nsamp;
+                if (P[j*sdr->nsamp+i]>maxP) {
+                    maxP=P[j*sdr->nsamp+i]; codei=i; freqi=j;
+                }
+            }
+        }
+    }
 
     /* C/N0 calculation */
     /* excluded index */
     exinds=codei-2*sdr->nsampchip; if(exinds<0) exinds+=sdr->nsamp;
     exinde=codei+2*sdr->nsampchip; if(exinde>=sdr->nsamp) exinde-=sdr->nsamp;
-    meanP=meanvd(&P[freqi*sdr->nsamp],sdr->nsamp,exinds,exinde); /* mean */
+    meanP=meanvf(&P[freqi*sdr->nsamp],sdr->nsamp,exinds,exinde); /* mean */
     sdr->acq.cn0=10*log10(maxP/meanP/sdr->ctime);
 
     /* peak ratio */
-    maxP2=maxvd(&P[freqi*sdr->nsamp],sdr->nsamp,exinds,exinde,&maxi);
+    maxP2=maxvf(&P[freqi*sdr->nsamp],sdr->nsamp,exinds,exinde,&maxi);
 
     sdr->acq.peakr=maxP/maxP2;
     sdr->acq.acqcodei=codei;
     sdr->acq.freqi=freqi;
-    sdr->acq.acqfreq=sdr->acq.freq[freqi];
+    sdr->acq.acqfreq=freq[freqi];
 
-    return sdr->acq.peakr>ACQTH;
+    return sdr->acq.peakr;
+}
+/* check acquisition result ----------------------------------------------------
+* check GNSS signal exists or not
+* carrier frequency is computed
+* args   : sdrch_t *sdr     I/0 sdr channel struct
+*          float  *P        I   normalized correlation power vector
+* return : int                  acquisition flag (0: not acquired, 1: acquired) 
+* note : first/second peak ratio and c/n0 computation
+*-----------------------------------------------------------------------------*/
+extern int checkacquisition(float *P, sdrch_t *sdr)
+{
+    return checkpeak(P,sdr->acq.freq,sdr->acq.nfreq,0,-1,sdr)>ACQTH;
+}
+/* coarse acquisition candidates -----------------------------------------------
+* select doppler bins of the coarse search whose correlation peak exceeds the
+* coarse threshold, strongest first (adjacent bins of a candidate excluded)
+* args   : float  *P        I   normalized correlation power vector (coarse)
+*          sdrch_t *sdr     I   sdr channel struct
+*          int    *cand     O   candidate frequency indexes (ACQNCAND x 1)
+* return : int                  number of candidates
+*-----------------------------------------------------------------------------*/
+static int acqcand(const float *P, const sdrch_t *sdr, int *cand)
+{
+    int i,j,n=0,nsamp=sdr->nsamp,nfreq=sdr->acq.nfreq,exinds,exinde,*codei;
+    float *maxP,max2;
+
+    maxP=(float*)malloc(sizeof(float)*nfreq);
+    codei=(int*)malloc(sizeof(int)*nfreq);
+    if (!maxP||!codei) {
+        free(maxP); free(codei);
+        return 0;
+    }
+    for (i=0;i<nfreq;i++) maxP[i]=maxvf(&P[i*nsamp],nsamp,-1,-1,&codei[i]);
+
+    while (n<ACQNCAND) {
+        maxvf(maxP,nfreq,-1,-1,&i);
+        if (maxP[i]<0.0f) break;
+
+        /* peak ratio excluding +/-2 chips around the peak */
+        exinds=codei[i]-2*sdr->nsampchip; if (exinds<0) exinds+=nsamp;
+        exinde=codei[i]+2*sdr->nsampchip; if (exinde>=nsamp) exinde-=nsamp;
+        max2=maxvf(&P[i*nsamp],nsamp,exinds,exinde,&j);
+        if (maxP[i]>ACQTHCOARSE*max2) {
+            cand[n++]=i;
+            if (i>0)       maxP[i-1]=-1.0f;
+            if (i<nfreq-1) maxP[i+1]=-1.0f;
+        }
+        maxP[i]=-1.0f;
+    }
+    free(maxP); free(codei);
+    return n;
+}
+/* fine acquisition search -----------------------------------------------------
+* second stage of two-stage acquisition: search +/-(coarse step) around each
+* coarse candidate with the fine step and full integration on new data
+* args   : sdrch_t *sdr     I/O sdr channel struct
+*          float  *P        I   normalized correlation power vector (coarse)
+*          float  *power    W   correlation power (nsamp x nffreq, may be P)
+*          uint64_t *buffloc O  buffer location at top of code
+* return : int                  acquisition flag (0: not acquired, 1: acquired)
+*-----------------------------------------------------------------------------*/
+extern int sdracqfine(sdrch_t *sdr, const float *P, float *power,
+                      uint64_t *buffloc)
+{
+    int i,j,c,ncand,cand[ACQNCAND],nf=sdr->acq.nffreq;
+    char *data;
+    uint64_t loc;
+
+    ncand=acqcand(P,sdr,cand);
+    if (ncand==0) return 0;
+
+    data=(char*)sdrmalloc(sizeof(char)*2*sdr->nsamp*sdr->dtype);
+
+    for (c=0;c<ncand;c++) {
+        for (j=0;j<nf;j++) {
+            sdr->acq.ffreq[j]=sdr->acq.freq[cand[c]]+(j-(nf-1)/2)*sdr->acq.fstep;
+        }
+        memset(power,0,sizeof(float)*sdr->nsamp*nf);
+
+        /* current buffer location */
+        loc=(sdrstat.fendbuffsize*rcvbuffcnt())-
+            (sdr->acq.fintg+1)*sdr->nsamp;
+        *buffloc=loc;
+
+        for (i=0;i<sdr->acq.fintg;i++) {
+            rcvgetbuff(&sdrini,loc,2*sdr->nsamp,sdr->ftype,sdr->dtype,data);
+            loc+=sdr->nsamp;
+
+            pcorrelator(data,sdr->dtype,sdr->ti,sdr->nsamp,sdr->acq.ffreq,nf,
+                sdr->crate,sdr->acq.nfft,sdr->xcode,sdrini.acqfd,power);
+
+            if (checkpeak(power,sdr->acq.ffreq,nf,0,-1,sdr)>ACQTH) {
+                /* set buffer location at top of code */
+                *buffloc+=sdr->acq.acqcodei;
+                sdrfree(data);
+                return 1;
+            }
+        }
+    }
+    sdrfree(data);
+    return 0;
+}
+/* aided search ----------------------------------------------------------------
+* narrow search around the last good tracking state (see sdracqaided). only
+* sdr->acq is written, so that acquisition workers may run it for a channel
+* args   : sdrch_t *sdr     I/O sdr channel struct
+*          uint64_t *buffloc O  buffer location at top of code (if acquired)
+* return : int                  1: acquired, 0: not acquired
+*-----------------------------------------------------------------------------*/
+static int acqaidsearch(sdrch_t *sdr, uint64_t *buffloc)
+{
+    sdracqaid_t *aid=&sdr->acq.aid;
+    int i,j,codec,win,nsamp=sdr->nsamp,found=0;
+    double freq[ACQAIDNFREQ],tcode,age=aid->age>0.0?aid->age:ACQAIDAGE;
+    char *data;
+    float *power;
+    uint64_t loc;
+
+    aid->flag=OFF;
+
+    /* current buffer location */
+    loc=(sdrstat.fendbuffsize*rcvbuffcnt())-(sdr->acq.fintg+1)*nsamp;
+
+    /* aiding data too old */
+    if (loc<=aid->buffloc||(loc-aid->buffloc)/sdr->f_sf>age) return 0;
+
+    /* predicted code phase at current location */
+    tcode=sdr->f_sf*sdr->clen/aid->codefreq;
+    codec=ROUND(tcode-fmod((double)(loc-aid->buffloc),tcode))%nsamp;
+    win=ACQAIDCHIP*sdr->nsampchip;
+
+    for (j=0;j<ACQAIDNFREQ;j++) {
+        freq[j]=aid->carrfreq+(j-(ACQAIDNFREQ-1)/2)*ACQAIDSTEP;
+    }
+    data=(char*)sdrmalloc(sizeof(char)*2*nsamp*sdr->dtype);
+    if (!(power=(float*)calloc(nsamp*ACQAIDNFREQ,sizeof(float)))) {
+        sdrfree(data);
+        return 0;
+    }
+    *buffloc=loc;
+
+    for (i=0;i<sdr->acq.fintg;i++) {
+        rcvgetbuff(&sdrini,loc,2*nsamp,sdr->ftype,sdr->dtype,data);
+        loc+=nsamp;
+
+        pcorrelator(data,sdr->dtype,sdr->ti,nsamp,freq,ACQAIDNFREQ,sdr->crate,
+            sdr->acq.nfft,sdr->xcode,sdrini.acqfd,power);
+
+        if (checkpeak(power,freq,ACQAIDNFREQ,codec,win,sdr)>ACQAIDTH) {
+            found=1;
+            break;
+        }
+    }
+    /* set buffer location at top of code */
+    if (found) *buffloc+=sdr->acq.acqcodei;
+
+    sdrfree(data);
+    free(power);
+    return found;
+}
+/* aided reacquisition --------------------------------------------------------
+* narrow search around the last good tracking state after a short loss of
+* lock: the code phase is propagated to the current buffer location with the
+* tracked code frequency and only a few doppler bins around the tracked
+* carrier frequency are searched (aiding data are used once)
+* aiding data older than aid->age (ACQAIDAGE if 0) are not used
+* args   : sdrch_t *sdr     I/O sdr channel struct
+* return : uint64_t             buffer location at top of code (if acquired)
+* note : run in the channel step only without acquisition workers, else the
+*        search is requested with ACQPRIO_AID (see sdracqrequest)
+*-----------------------------------------------------------------------------*/
+extern uint64_t sdracqaided(sdrch_t *sdr)
+{
+    uint64_t buffloc=0;
+
+    if (acqaidsearch(sdr,&buffloc)) {
+        sdr->flagacq=ON;
+        sdr->trk.carrfreq=sdr->acq.acqfreq;
+        sdr->trk.codefreq=sdr->crate;
+    }
+    return buffloc;
+}
+/* check batch compatibility ---------------------------------------------------
+* channels in one batch must share the front end, FFT size, integration and
+* doppler step. the search windows may differ (see sdracqgrid), each channel
+* correlates its own bins of the shared data spectra
+* args   : sdrch_t *sdr1    I   sdr channel struct
+*          sdrch_t *sdr2    I   sdr channel struct
+* return : int                  1: compatible, 0: not compatible
+*-----------------------------------------------------------------------------*/
+static int acqcompat(const sdrch_t *sdr1, const sdrch_t *sdr2)
+{
+    return sdr1->ftype==sdr2->ftype&&sdr1->dtype==sdr2->dtype&&
+           sdr1->nsamp==sdr2->nsamp&&sdr1->acq.nfft==sdr2->acq.nfft&&
+           sdr1->acq.intg==sdr2->acq.intg&&sdr1->acq.step==sdr2->acq.step;
+}
+/* acquisition request ---------------------------------------------------------
+* submit acquisition request to acquisition workers and receive the result
+* called from the channel step (sdrchstep) instead of sdraqcuisition
+* args   : sdrch_t *sdr     I/O sdr channel struct
+* return : uint64_t             buffer location at top of code (if acquired)
+* note : satellites lost within ACQLOSTAGE are requested with high priority,
+*        with aiding data (see sdracqaided) with highest priority and searched
+*        on the narrow aided grid first
+*-----------------------------------------------------------------------------*/
+extern uint64_t sdracqrequest(sdrch_t *sdr)
+{
+    uint64_t buffloc=0;
+    int prio=ACQPRIO_NEW;
+
+    /* time since last good tracking (see sdracqaided) */
+    if (!sdr->acq.flagreq&&sdrini.acqaid&&sdr->acq.aid.flag) {
+        prio=ACQPRIO_AID;
+    }
+    else if (!sdr->acq.flagreq&&sdr->acq.aid.buffloc>0) {
+        buffloc=sdrstat.fendbuffsize*rcvbuffcnt();
+        if (buffloc<sdr->acq.aid.buffloc+(uint64_t)(ACQLOSTAGE*sdr->f_sf)) {
+            prio=ACQPRIO_LOST;
+        }
+        buffloc=0;
+    }
+    mlock(hacqmtx);
+    if (sdr->acq.flagres) {
+        buffloc=sdr->acq.buffloc;
+        sdr->acq.flagreq=OFF;
+        sdr->acq.flagres=OFF;
+        sdr->flagacq=ON;
+    }
+    else if (!sdr->acq.flagreq) {
+        sdr->acq.prio=prio;
+        sdr->acq.treq=tickgetus()/1000;
+        sdr->acq.flagreq=ON;
+    }
+    unmlock(hacqmtx);
+
+    // Set acquisition result
+    if (sdr->flagacq) {
+        sdr->trk.carrfreq=sdr->acq.acqfreq;
+        sdr->trk.codefreq=sdr->crate;
+    }
+    else {
+        sdrdefer(sdr,ACQREQWAIT);
+    }
+    return buffloc;
+}
+/* batched multi-PRN acquisition -----------------------------------------------
+* acquire several channels from one data block: the doppler shifted data
+* spectrum is computed once per residual frequency of the union of the search
+* grids and correlated with the frequency domain code of every channel in the
+* batch whose grid has bins of that residual
+* args   : sdrch_t **sdr    I/O sdr channel structs (see acqcompat)
+*          int    n         I   number of channels
+* return : int                  number of acquired channels
+*-----------------------------------------------------------------------------*/
+extern int sdracqbatch(sdrch_t **sdr, int n)
+{
+    int i,j,k,r,nres=0,nrem=n,nacq=0,*done=NULL,*shift,*resi,*off;
+    int m=sdr[0]->acq.nfft,nsamp=sdr[0]->nsamp,nfreq=0,npow;
+    char *data;
+    short *dataI,*dataQ;
+    cpx_t *datax,*work;
+    float **power;
+    double *fres,*freq;
+    uint64_t buffloc,bufflocs;
+
+    /* union of search grids (channel k: freq[off[k]...off[k]+nfreq-1]) */
+    off=(int*)malloc(sizeof(int)*(n+1));
+    for (k=0;off&&k<n;k++) {
+        off[k]=nfreq;
+        nfreq+=sdr[k]->acq.nfreq;
+    }
+    if (off) off[n]=nfreq;
+
+    /* memory allocation */
+    data=(char*)sdrmalloc(sizeof(char)*(m+64)*sdr[0]->dtype);
+    dataI=(short*)sdrmalloc(sizeof(short)*(m+64));
+    dataQ=(short*)sdrmalloc(sizeof(short)*(m+64));
+    datax=cpxmalloc(m);
+    work=cpxmalloc(m);
+    done=(int*)calloc(n,sizeof(int));
+    freq=(double*)malloc(sizeof(double)*(nfreq+1));
+    fres=(double*)malloc(sizeof(double)*(nfreq+1));
+    shift=(int*)malloc(sizeof(int)*(nfreq+1));
+    resi=(int*)malloc(sizeof(int)*(nfreq+1));
+    if ((power=(float**)calloc(n,sizeof(float*)))) {
+        for (k=0;k<n;k++) {
+            npow=sdr[k]->acq.nfreq>sdr[k]->acq.nffreq?
+                 sdr[k]->acq.nfreq:sdr[k]->acq.nffreq;
+            power[k]=(float*)calloc(nsamp*npow,sizeof(float));
+            if (!power[k]) nrem=0;
+        }
+    }
+    if (!data||!dataI||!dataQ||!datax||!work||!done||!power||!nrem||!off||
+        !freq||!fres||!shift||!resi) {
+        SDRPRINTF("error: sdracqbatch memory allocation\n");
+        nrem=0;
+    }
+    else {
+        /* doppler bins (FFT bin shifts and residual frequencies) */
+        for (k=0;k<n;k++) {
+            memcpy(freq+off[k],sdr[k]->acq.freq,
+                sizeof(double)*sdr[k]->acq.nfreq);
+        }
+        nres=pcorrbins(freq,nfreq,sdr[0]->ti,m,sdrini.acqfd,fres,shift,resi);
+    }
+
+    /* current buffer location */
+    buffloc=(sdrstat.fendbuffsize*rcvbuffcnt())-(sdr[0]->acq.intg+1)*nsamp;
+    bufflocs=buffloc;
+
+    /* acquisition integration */
+    for (i=0;i<sdr[0]->acq.intg&&nrem>0;i++) {
+        /* get current 1ms data */
+        rcvgetbuff(&sdrini,buffloc,2*nsamp,sdr[0]->ftype,sdr[0]->dtype,data);
+        buffloc+=nsamp;
+
+        /* fft correlation (one data spectrum for all channels) */
+        for (r=0;r<nres;r++) {
+            pcorrspec(data,sdr[0]->dtype,sdr[0]->ti,m,fres[r],dataI,dataQ,
+                datax);
+
+            for (k=0;k<n;k++) {
+                if (done[k]) continue;
+                for (j=off[k];j<off[k+1];j++) {
+                    if (resi[j]!=r) continue;
+                    cpxconvx(NULL,datax,shift[j],sdr[k]->xcode,m,nsamp,1,work,
+                        &power[k][(j-off[k])*nsamp]);
+                }
+            }
+        }
+        /* check acquisition result (coarse search: after integration) */
+        for (k=0;k<n&&!sdrini.acq2step;k++) {
+            if (done[k]||!checkacquisition(power[k],sdr[k])) continue;
+            done[k]=1; nrem--; nacq++;
+
+            /* set buffer location at top of code */
+            mlock(hacqmtx);
+            sdr[k]->acq.buffloc=bufflocs+sdr[k]->acq.acqcodei;
+            sdr[k]->acq.flagres=ON;
+            unmlock(hacqmtx);
+        }
+    }
+    /* fine search around coarse candidates (per channel) */
+    for (k=0;k<n&&nrem>0&&sdrini.acq2step;k++) {
+        if (!sdracqfine(sdr[k],power[k],power[k],&buffloc)) continue;
+        nacq++;
+
+        mlock(hacqmtx);
+        sdr[k]->acq.buffloc=buffloc;
+        sdr[k]->acq.flagres=ON;
+        unmlock(hacqmtx);
+    }
+    if (power) {
+        for (k=0;k<n;k++) free(power[k]);
+        free(power);
+    }
+    sdrfree(data); sdrfree(dataI); sdrfree(dataQ);
+    cpxfree(datax); cpxfree(work);
+    free(done); free(off); free(freq); free(fres); free(shift); free(resi);
+    return nacq;
+}
+/* set doppler search grid -----------------------------------------------------
+* set search frequencies of channel: narrow band around the predicted carrier
+* frequency if the satellite is predicted visible (see visPredict), full band
+* otherwise. the narrow band is centred on the nearest bin of the full band
+* grid, so that batched channels share residual frequencies (see sdracqbatch)
+* args   : sdrch_t *sdr     I/O sdr channel struct
+* return : none
+* note : call with hacqmtx locked before search
+*-----------------------------------------------------------------------------*/
+extern void sdracqgrid(sdrch_t *sdr)
+{
+    sdracq_t *acq=&sdr->acq;
+    double fc=sdr->f_if+sdr->foffset,hband=acq->hband;
+    int i;
+
+    if (sdrini.acqvis&&acq->vis==ACQVIS_UP) {
+        fc+=ROUND((acq->visfreq-fc)/acq->step)*acq->step;
+        hband=ACQVISHBAND;
+    }
+    acq->nfreq=2*(int)(hband/acq->step)+1;
+    for (i=0;i<acq->nfreq;i++) {
+        acq->freq[i]=fc+(i-(acq->nfreq-1)/2)*acq->step;
+    }
+}
+/* request ready for search (not shed, see shedthread) -----------------------*/
+static int acqready(const sdrch_t *sdr, unsigned long tick)
+{
+    const sdracq_t *acq=&sdr->acq;
+
+    return acq->flagreq&&!acq->flagres&&!acq->flagbusy&&acq->tnext<=tick&&
+           (!sdrini.acqvis||acq->vis!=ACQVIS_DOWN)&&
+           atomget(sdr->task.shed)==SHED_NONE;
+}
+/* request priority -----------------------------------------------------------*/
+static int acqprio(const sdracq_t *acq)
+{
+    if (acq->prio==ACQPRIO_AID) return ACQPRIO_AID;
+    if (acq->prio==ACQPRIO_LOST) return ACQPRIO_LOST;
+    if (sdrini.acqvis&&acq->vis==ACQVIS_UP) return ACQPRIO_VIS;
+    return ACQPRIO_NEW;
+}
+/* acquisition worker thread ---------------------------------------------------
+* take acquisition requests of sdr channels in order of priority and
+* request time (predicted elevation for visible satellites) and search them,
+* in batches of compatible channels if batched acquisition is enabled (see
+* sdracqbatch). satellites predicted below the mask are not searched
+* args   : void   *arg      I   not used
+* return : none
+* note : several workers may run concurrently (sdrini.acqnthr). a request
+*        that fails is queued again after exponential backoff (ACQBACKOFF to
+*        ACQBACKOFFMAX). aided requests (ACQPRIO_AID) are searched alone on
+*        the narrow aided grid, if that fails they are queued again at once
+*        for a full search
+*-----------------------------------------------------------------------------*/
+extern void *acqthread(void *arg)
+{
+    sdrch_t *sdr[MAXSAT];
+    sdracq_t *acq;
+    unsigned long tick,backoff;
+    uint64_t buffloc;
+    int i,j,n,lead,p,plead=0,found;
+
+    while (!sdrstat.stopflag) {
+        tick=tickgetus()/1000;
+
+        /* highest priority and oldest request first */
+        mlock(hacqmtx);
+        for (i=0,lead=-1;i<sdrini.nch;i++) {
+            acq=&sdrch[i].acq;
+            if (!acqready(&sdrch[i],tick)) continue;
+            sdracqgrid(&sdrch[i]);
+            p=acqprio(acq);
+            if (lead<0||p>plead||(p==plead&&(p==ACQPRIO_VIS?
+                acq->visel>sdrch[lead].acq.visel:
+                acq->treq<sdrch[lead].acq.treq))) {
+                lead=i; plead=p;
+            }
+        }
+        n=0;
+        if (lead>=0) {
+            sdr[n++]=&sdrch[lead];
+
+            /* compatible requests join the batch (aided search alone) */
+            for (i=0;i<sdrini.nch&&sdrini.acqbatch&&plead!=ACQPRIO_AID;i++) {
+                if (i==lead||!acqready(&sdrch[i],tick)||
+                    acqprio(&sdrch[i].acq)==ACQPRIO_AID||
+                    !acqcompat(sdr[0],&sdrch[i])) continue;
+                sdr[n++]=&sdrch[i];
+            }
+            for (i=0;i<n;i++) sdr[i]->acq.flagbusy=ON;
+        }
+        unmlock(hacqmtx);
+
+        if (n==0) {
+            sleepms(ACQREQWAIT);
+            continue;
+        }
+        /* aided search, full search at ACQPRIO_LOST next if not acquired */
+        if (plead==ACQPRIO_AID) {
+            found=acqaidsearch(sdr[0],&buffloc);
+            mlock(hacqmtx);
+            sdr[0]->acq.flagbusy=OFF;
+            if (found) {
+                sdr[0]->acq.buffloc=buffloc;
+                sdr[0]->acq.flagres=ON;
+            }
+            else sdr[0]->acq.prio=ACQPRIO_LOST;
+            unmlock(hacqmtx);
+            continue;
+        }
+        sdracqbatch(sdr,n);
+
+        /* backoff of failed requests */
+        tick=tickgetus()/1000;
+        mlock(hacqmtx);
+        for (i=0;i<n;i++) {
+            acq=&sdr[i]->acq;
+            acq->flagbusy=OFF;
+            if (acq->flagres) {
+                acq->nfail=0;
+                continue;
+            }
+            acq->nfail++;
+            for (j=1,backoff=ACQBACKOFF;j<acq->nfail&&backoff<ACQBACKOFFMAX;
+                 j++) backoff*=2;
+            if (backoff>ACQBACKOFFMAX) backoff=ACQBACKOFFMAX;
+            acq->tnext=tick+backoff;
+            acq->treq=tick;
+        }
+        unmlock(hacqmtx);
+    }
+    return THRETVAL;
+}
+/* acquisition benchmark struct ---------------------------------------------*/
+typedef struct {
+    sdrch_t sdr;     // sdr channel struct (own channel per thread)
+    char *data;      // sampling data (noise)
+    float *power;    // correlation power
+    int nsrch;       // number of searches
+    double time;     // elapsed time (s)
+} acqbench_t;
+
+static pthread_barrier_t hbenchbar; // benchmark start barrier
+
+/* acquisition benchmark thread ---------------------------------------------*/
+static void *acqbenchthread(void *arg)
+{
+    acqbench_t *bench=(acqbench_t*)arg;
+    sdrch_t *sdr=&bench->sdr;
+    unsigned long tick;
+
+    pthread_barrier_wait(&hbenchbar);
+    tick=tickgetus();
+    do {
+        pcorrelator(bench->data,sdr->dtype,sdr->ti,sdr->nsamp,sdr->acq.freq,
+            sdr->acq.nfreq,sdr->crate,sdr->acq.nfft,sdr->xcode,sdrini.acqfd,
+            bench->power);
+        bench->nsrch++;
+        bench->time=(tickgetus()-tick)*1E-6;
+    } while (bench->time<ACQBENCHTIME);
+
+    return THRETVAL;
+}
+/* acquisition benchmark -------------------------------------------------------
+* measure acquisition throughput (searches/s) versus number of threads
+* one search is a parallel code phase/doppler search of one PRN over 1 code
+* period (pcorrelator), each thread searches its own channel on noise data
+* args   : int    maxthread I   max number of threads
+* return : int                  0:okay -1:error
+* note : front end and acquisition settings are taken from ini file, run as
+*        "gnss-sdrlib-pvt -bench [maxthread]" (use taskset to select cores)
+*-----------------------------------------------------------------------------*/
+extern int acqbench(int maxthread)
+{
+    acqbench_t *bench=NULL;
+    thread_t *hbench=NULL;
+    double rate,rate1=0.0;
+    int i,j,n,nthread,ret=-1;
+
+    if (maxthread<1) maxthread=1;
+    if (maxthread>MAXSAT) maxthread=MAXSAT;
+
+    fftwf_init_threads();
+    fftinit(sdrini.fftwisdom,sdrini.fftplanner);
+
+    if (!(bench=(acqbench_t*)sdrmalloc(maxthread*sizeof(acqbench_t)))||
+        !(hbench=(thread_t*)calloc(maxthread,sizeof(thread_t)))) {
+        SDRPRINTF("error: acqbench memory allocation\n");
+        goto cleanup;
+    }
+    memset(bench,0,maxthread*sizeof(acqbench_t)); // cache aligned sdrch_t
+    for (i=0;i<maxthread;i++) {
+        if (initsdrch(i+1,SYS_GPS,i+1,CTYPE_L1CA,sdrini.dtype[0],FTYPE1,
+                sdrini.f_gain[0],sdrini.f_bias[0],sdrini.f_clock[0],
+                sdrini.f_cf[0],sdrini.f_sf[0],sdrini.f_if[0],
+                &bench[i].sdr)<0) {
+            SDRPRINTF("error: acqbench initsdrch\n");
+            goto cleanup;
+        }
+        n=2*bench[i].sdr.nsamp*bench[i].sdr.dtype;
+        bench[i].data=(char*)sdrmalloc(sizeof(char)*(n+64));
+        bench[i].power=(float*)calloc(bench[i].sdr.nsamp*
+            bench[i].sdr.acq.nfreq,sizeof(float));
+        if (!bench[i].data||!bench[i].power) {
+            SDRPRINTF("error: acqbench memory allocation\n");
+            goto cleanup;
+        }
+        for (j=0;j<n;j++) bench[i].data[j]=(char)(rand()%7-3);
+    }
+    SDRPRINTF("acquisition benchmark: fs=%.3f MHz, %d doppler bins, "
+        "%d FFT points, FDSEARCH=%d\n",sdrini.f_sf[0]/1E6,
+        bench[0].sdr.acq.nfreq,bench[0].sdr.acq.nfft,sdrini.acqfd);
+
+    for (nthread=1;nthread<=maxthread;nthread++) {
+        pthread_barrier_init(&hbenchbar,NULL,nthread);
+        for (i=0;i<nthread;i++) {
+            bench[i].nsrch=0;
+            cratethread(hbench[i],acqbenchthread,&bench[i]);
+        }
+        for (i=0,rate=0.0;i<nthread;i++) {
+            waitthread(hbench[i]);
+            rate+=bench[i].nsrch/bench[i].time;
+        }
+        pthread_barrier_destroy(&hbenchbar);
+
+        if (nthread==1) rate1=rate;
+        SDRPRINTF("threads=%2d: %8.1f searches/s (%5.2f x single thread)\n",
+            nthread,rate,rate/rate1);
+    }
+    ret=0;
+
+cleanup:
+    // channels not initialized yet are zero filled (freesdrch skips NULL)
+    for (i=0;bench&&i<maxthread;i++) {
+        sdrfree(bench[i].data);
+        free(bench[i].power);
+        freesdrch(&bench[i].sdr);
+    }
+    sdrfree(bench); free(hbench);
+    fftquit();
+    return ret;
 }
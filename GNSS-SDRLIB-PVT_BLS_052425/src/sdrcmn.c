@@ -7,9 +7,42 @@
 //-----------------------------------------------------------------------------*/
 #include "sdr.h"
 
-#define CDIV          32               /* carrier lookup table (cycle) */
-#define CMASK         0x1F             /* carrier lookup table mask */
-#define CSCALE        (1.0/32.0)       /* carrier lookup table scale (LSB) */
+#define CDIV          64               /* carrier lookup table (cycle) */
+#define CBITS         26               /* carrier table index shift (32-log2(CDIV)) */
+#define CAMP          127              /* carrier lookup table amplitude */
+#define CSCALE        (1.0/CAMP)       /* carrier lookup table scale (LSB) */
+#define FFTPLANBLK    32               /* fft plan cache block (plans) */
+#define MAXFFTBLK     64               /* max number of fft plan cache blocks */
+#define CORRBLK       1024             /* fused correlator block (samples) */
+#define CSHIFT16      7                /* carrier mixed int16 samples shift */
+#define MIXSCALE(t)   ((t)==DTYPEIQ16?CSCALE*(1<<CSHIFT16):CSCALE) /* scale of
+                                          carrier mixed data to sample unit */
+
+/* SIMD kernel targets (built for any x86-64 cpu, selected by simdinit) */
+#if defined(SSE2_ENABLE)
+#define TARGET_SSE2   __attribute__((target("sse2,ssse3")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,fma")))
+#endif
+
+/* fft plan cache struct */
+typedef struct {
+        int n;                         /* number of points */
+        int sign;                      /* direction (FFTW_FORWARD/BACKWARD) */
+        int align;                     /* array alignment (fftwf_alignment_of) */
+        fftwf_plan plan;               /* fftw plan (in-place) */
+} fftplan_t;
+
+#define FFTPLAN(i)    fftplans[(i)/FFTPLANBLK][(i)%FFTPLANBLK] /* plan entry */
+
+static fftplan_t *fftplans[MAXFFTBLK]; /* fft plan cache blocks (entries
+                                          are read-only once published by
+                                          nfftplan, blocks are never moved) */
+static int nfftplan=0;                 /* number of cached fft plans */
+static unsigned fftflag=FFTW_ESTIMATE; /* fftw planner flag */
+static char fftwisdom[1024]="";        /* fftw wisdom file path */
+static __thread unsigned long nalloc=0; /* number of sdrmalloc/cpxmalloc
+                                          calls (per thread) */
 
 /* get full path from relative path --------------------------------------------
 * args   : char *relpath    I   relative path
@@ -50,6 +83,23 @@ extern unsigned long tickgetus(void)
 #endif
 }
 
+/* set timeout time ------------------------------------------------------------
+* set absolute timeout time for timedwaitevent
+* args   : struct timespec *timeout O timeout time (realtime clock)
+*          int    waitms    I   wait time (ms)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void settimeout(struct timespec *timeout, int waitms)
+{
+        clock_gettime(CLOCK_REALTIME,timeout);
+        timeout->tv_sec+=waitms/1000;
+        timeout->tv_nsec+=(long)(waitms%1000)*1000000L;
+        if (timeout->tv_nsec>=1000000000L) {
+                timeout->tv_sec++;
+                timeout->tv_nsec-=1000000000L;
+        }
+}
+
 /* calculation log2(x) ---------------------------------------------------------
 * args   : double x         I   x data
 * return : double               log2(x)
@@ -75,18 +125,14 @@ extern int calcfftnum(double x, int next)
 * memorry allocation
 * args   : int    size      I   sizee of allocation
 * return : void*                allocated pointer
+* notes  : the pointer is aligned to SDRALIGN (cache line) bytes
 *-----------------------------------------------------------------------------*/
 extern void *sdrmalloc(size_t size)
 {
-#if !defined(SSE2_ENABLE)
-        return malloc(size);
-//#elif defined(WIN32)
-//    return _aligned_malloc(size,16);
-#else
         void *p;
-        if (posix_memalign(&p,16,size)) return NULL;
+        nalloc++;
+        if (posix_memalign(&p,SDRALIGN,size)) return NULL;
         return p;
-#endif
 }
 
 /* sdr free --------------------------------------------------------------------
@@ -96,11 +142,53 @@ extern void *sdrmalloc(size_t size)
 *-----------------------------------------------------------------------------*/
 extern void sdrfree(void *p)
 {
-#if !defined(SSE2_ENABLE)
-        free(p);
-#else
         free(p);
-#endif
+}
+
+/* ring buffer allocation ------------------------------------------------------
+* allocate ring buffer mapped twice back to back (memfd), so that any window
+* of up to size bytes starting in the ring is contiguous (p[i+size] is p[i])
+* args   : size_t size      I   ring buffer size (bytes, page size multiple)
+* return : void*                ring buffer (NULL: not available)
+*-----------------------------------------------------------------------------*/
+extern void *ringalloc(size_t size)
+{
+        char *p;
+        int fd;
+
+        if (size==0||size%(size_t)sysconf(_SC_PAGESIZE)) return NULL;
+        if ((fd=memfd_create("sdrring",MFD_CLOEXEC))<0) return NULL;
+        if (ftruncate(fd,(off_t)size)<0) {
+                close(fd);
+                return NULL;
+        }
+        /* reserve address range and map the file twice into it */
+        p=(char*)mmap(NULL,2*size,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if (p==MAP_FAILED) {
+                close(fd);
+                return NULL;
+        }
+        if (mmap(p,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,fd,0)==
+            MAP_FAILED||
+            mmap(p+size,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,fd,0)==
+            MAP_FAILED) {
+                munmap(p,2*size);
+                close(fd);
+                return NULL;
+        }
+        close(fd); /* mappings keep the memory */
+        return p;
+}
+
+/* ring buffer free ------------------------------------------------------------
+* free ring buffer allocated by ringalloc
+* args   : void   *p        I   ring buffer
+*          size_t size      I   ring buffer size (bytes)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void ringfree(void *p, size_t size)
+{
+        if (p) munmap(p,2*size);
 }
 
 /* complex malloc --------------------------------------------------------------
@@ -110,9 +198,22 @@ extern void sdrfree(void *p)
 *-----------------------------------------------------------------------------*/
 extern cpx_t *cpxmalloc(int n)
 {
+        nalloc++;
         return (cpx_t *)fftwf_malloc(sizeof(cpx_t)*n+32);
 }
 
+/* number of sdrmalloc/cpxmalloc calls ---------------------------------------
+* number of sdrmalloc/cpxmalloc calls made by the calling thread
+* args   : none
+* return : unsigned long        number of calls
+* notes  : difference of two calls gives the calls in between (malloc/calloc
+*          and library allocations are not counted)
+*-----------------------------------------------------------------------------*/
+extern unsigned long sdrnalloc(void)
+{
+        return nalloc;
+}
+
 /* complex free ----------------------------------------------------------------
 * free complex data
 * args   : cpx_t  *cpx      I/O input/output complex data
@@ -123,54 +224,154 @@ extern void cpxfree(cpx_t *cpx)
         fftwf_free(cpx);
 }
 
+/* initialize fft plan cache --------------------------------------------------
+* set fftw planner and load fftw wisdom
+* args   : char   *wisdom   I   fftw wisdom file path ("": no wisdom file)
+*          int    planner   I   fftw planner (0:estimate,1:measure,2:patient)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void fftinit(const char *wisdom, int planner)
+{
+        fftflag=planner==2 ? FFTW_PATIENT :
+                (planner==1 ? FFTW_MEASURE : FFTW_ESTIMATE);
+
+        strncpy(fftwisdom,wisdom,sizeof(fftwisdom)-1);
+        if (fftwisdom[0]&&fftwf_import_wisdom_from_filename(fftwisdom)) {
+                SDRPRINTF("fft wisdom loaded: %s\n",fftwisdom);
+        }
+}
+
+/* free fft plan cache ---------------------------------------------------------
+* save fftw wisdom and destroy cached fft plans
+* args   : none
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void fftquit(void)
+{
+        int i;
+
+        mlock(hfftmtx);
+        if (fftwisdom[0]&&nfftplan>0&&fftflag!=FFTW_ESTIMATE) {
+                if (!fftwf_export_wisdom_to_filename(fftwisdom)) {
+                        SDRPRINTF("error: fft wisdom save: %s\n",fftwisdom);
+                }
+        }
+        for (i=0; i<nfftplan; i++) {
+                fftwf_destroy_plan(FFTPLAN(i).plan);
+        }
+        for (i=0; i<MAXFFTBLK; i++) {
+                free(fftplans[i]);
+                fftplans[i]=NULL;
+        }
+        nfftplan=0;
+        unmlock(hfftmtx);
+}
+
+/* find published fft plan --------------------------------------------------*/
+static fftwf_plan findplan(int n, int sign, int align)
+{
+        int i,nplan=__atomic_load_n(&nfftplan,__ATOMIC_ACQUIRE);
+
+        for (i=0; i<nplan; i++) {
+                if (FFTPLAN(i).n==n&&FFTPLAN(i).sign==sign&&
+                    FFTPLAN(i).align==align) {
+                        return FFTPLAN(i).plan;
+                }
+        }
+        return NULL;
+}
+
+/* publish fft plan ---------------------------------------------------------*/
+static int addplan(int n, int sign, int align, fftwf_plan plan)
+{
+        int blk=nfftplan/FFTPLANBLK;
+
+        if (blk>=MAXFFTBLK) return 0;
+        if (!fftplans[blk]&&
+            !(fftplans[blk]=(fftplan_t *)malloc(sizeof(fftplan_t)*FFTPLANBLK))) {
+                return 0;
+        }
+        FFTPLAN(nfftplan).n=n;
+        FFTPLAN(nfftplan).sign=sign;
+        FFTPLAN(nfftplan).align=align;
+        FFTPLAN(nfftplan).plan=plan;
+        __atomic_store_n(&nfftplan,nfftplan+1,__ATOMIC_RELEASE);
+        return 1;
+}
+
+/* get fft plan ----------------------------------------------------------------
+* get cached in-place fft plan (the plan is created at first call)
+* args   : int    n         I   number of points
+*          int    sign      I   direction (FFTW_FORWARD or FFTW_BACKWARD)
+*          cpx_t  *cpx      I   complex data to be transformed (alignment)
+* return : fftwf_plan           fftw plan (NULL: error)
+* notes  : planning is done on a scratch array, so that FFTW_MEASURE/PATIENT
+*          does not overwrite input data. plans are executed by
+*          fftwf_execute_dft for arrays of the same alignment
+*          only plan creation is serialized by hfftmtx (fftw planner is not
+*          thread safe). cached plans are shared read-only and executed
+*          concurrently by all threads on their own arrays
+*          the cache grows by blocks of FFTPLANBLK plans. every plan returned
+*          is cached and destroyed by fftquit (NULL if the cache is full)
+*-----------------------------------------------------------------------------*/
+extern fftwf_plan fftplan(int n, int sign, cpx_t *cpx)
+{
+        fftwf_plan plan;
+        int align=fftwf_alignment_of((float *)cpx);
+        char *buff;
+
+        /* published plans are looked up without lock */
+        if ((plan=findplan(n,sign,align))) return plan;
+
+        mlock(hfftmtx);
+        plan=findplan(n,sign,align);
+
+        if (!plan&&(buff=(char *)fftwf_malloc(sizeof(cpx_t)*n+64))) {
+                fftwf_plan_with_nthreads(NFFTTHREAD); /* fft execute in multi threads */
+                plan=fftwf_plan_dft_1d(n,(cpx_t *)(buff+align),
+                                       (cpx_t *)(buff+align),sign,fftflag);
+                fftwf_free(buff);
+
+                if (plan&&!addplan(n,sign,align,plan)) {
+                        SDRPRINTF("error: fft plan cache overflow\n");
+                        fftwf_destroy_plan(plan);
+                        plan=NULL;
+                }
+        }
+        unmlock(hfftmtx);
+        return plan;
+}
+
 /* complex FFT -----------------------------------------------------------------
 * cpx=fft(cpx)
-* args   : fftwf_plan plan  I   fftw plan (NULL: create new plan)
+* args   : fftwf_plan plan  I   fftw plan (NULL: cached plan, see fftplan)
 *          cpx_t  *cpx      I/O input/output complex data
 *          int    n         I   number of input/output data
 * return : none
 *-----------------------------------------------------------------------------*/
 extern void cpxfft(fftwf_plan plan, cpx_t *cpx, int n)
 {
-#ifdef FFTMTX
-        mlock(hfftmtx);
-#endif
-        if (plan==NULL) {
-                fftwf_plan_with_nthreads(NFFTTHREAD); /* fft execute in multi threads */
-                plan=fftwf_plan_dft_1d(n,cpx,cpx,FFTW_FORWARD,FFTW_ESTIMATE);
-                fftwf_execute_dft(plan,cpx,cpx); /* fft */
-                fftwf_destroy_plan(plan);
-        } else {
-                fftwf_execute_dft(plan,cpx,cpx); /* fft */
+        if (plan==NULL&&!(plan=fftplan(n,FFTW_FORWARD,cpx))) {
+                SDRPRINTF("error: cpxfft plan\n");
+                return;
         }
-#ifdef FFTMTX
-        unmlock(hfftmtx);
-#endif
+        fftwf_execute_dft(plan,cpx,cpx); /* fft */
 }
 
 /* complex IFFT ----------------------------------------------------------------
 * cpx=ifft(cpx)
-* args   : fftwf_plan plan  I   fftw plan (NULL: create new plan)
+* args   : fftwf_plan plan  I   fftw plan (NULL: cached plan, see fftplan)
 *          cpx_t  *cpx      I/O input/output complex data
 *          int    n         I   number of input/output data
 * return : none
 *-----------------------------------------------------------------------------*/
 extern void cpxifft(fftwf_plan plan, cpx_t *cpx, int n)
 {
-#ifdef FFTMTX
-        mlock(hfftmtx);
-#endif
-        if (plan==NULL) {
-                fftwf_plan_with_nthreads(NFFTTHREAD); /* fft execute in multi threads */
-                plan=fftwf_plan_dft_1d(n,cpx,cpx,FFTW_BACKWARD,FFTW_ESTIMATE);
-                fftwf_execute_dft(plan,cpx,cpx); /* fft */
-                fftwf_destroy_plan(plan);
-        } else {
-                fftwf_execute_dft(plan,cpx,cpx); /* fft */
+        if (plan==NULL&&!(plan=fftplan(n,FFTW_BACKWARD,cpx))) {
+                SDRPRINTF("error: cpxifft plan\n");
+                return;
         }
-#ifdef FFTMTX
-        unmlock(hfftmtx);
-#endif
+        fftwf_execute_dft(plan,cpx,cpx); /* ifft */
 }
 
 /* convert short vector to complex vector --------------------------------------
@@ -217,44 +418,223 @@ extern void cpxcpxf(const float *II, const float *QQ, double scale, int n,
 
 /* FFT convolution -------------------------------------------------------------
 * conv=sqrt(abs(ifft(fft(cpxa).*conj(cpxb))).^2)
-* args   : fftwf_plan plan  I   fftw plan (NULL: create new plan)
-*          fftwf_plan iplan I   ifftw plan (NULL: create new plan)
+* args   : fftwf_plan plan  I   fftw plan (NULL: cached plan, see fftplan)
+*          fftwf_plan iplan I   ifftw plan (NULL: cached plan, see fftplan)
 *          cpx_t  *cpxa     I   input complex data array
 *          cpx_t  *cpxb     I   input complex data array
 *          int    m         I   number of input data
 *          int    n         I   number of output data
 *          int    flagsum   I   cumulative sum flag (conv+=conv)
-*          double *conv     O   output convolution data
+*          float  *conv     O   output convolution power
 * return : none
 *-----------------------------------------------------------------------------*/
 extern void cpxconv(fftwf_plan plan, fftwf_plan iplan, cpx_t *cpxa, cpx_t *cpxb,
-                    int m, int n, int flagsum, double *conv)
+                    int m, int n, int flagsum, float *conv)
 {
-        float *p,*q,real,m2=(float)m*m;
-        int i;
-
         cpxfft(plan,cpxa,m); /* fft */
 
-        for (i=0,p=(float *)cpxa,q=(float *)cpxb; i<m; i++,p+=2,q+=2) {
+        cpxconvx(iplan,cpxa,0,cpxb,m,n,flagsum,cpxa,conv);
+}
+
+/* complex multiply by conjugate ---------------------------------------------*/
+static void cpxmulconj_c(const float *p, const float *q, float *r, int n)
+{
+        float real;
+        int i;
+
+        for (i=0; i<n; i++,p+=2,q+=2,r+=2) {
                 real=-p[0]*q[0]-p[1]*q[1];
-                p[1]= p[0]*q[1]-p[1]*q[0];
-                p[0]=real;
+                r[1]= p[0]*q[1]-p[1]*q[0];
+                r[0]=real;
+        }
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void cpxmulconj_sse2(const float *p, const float *q,
+                                        float *r, int n)
+{
+        const __m128 sign=_mm_setr_ps(-0.0f,0.0f,-0.0f,0.0f);
+        __m128 xp,xq,xr,xi,xs;
+        int i=0;
+
+        for (; i<n-1; i+=2,p+=4,q+=4,r+=4) {
+                xp=_mm_loadu_ps(p);
+                xq=_mm_loadu_ps(q);
+                xr=_mm_xor_ps(_mm_shuffle_ps(xp,xp,0xA0),sign); /* -p0, p0 */
+                xi=_mm_shuffle_ps(xp,xp,0xF5);                  /*  p1, p1 */
+                xs=_mm_shuffle_ps(xq,xq,0xB1);                  /*  q1, q0 */
+                xr=_mm_sub_ps(_mm_mul_ps(xr,xq),_mm_mul_ps(xi,xs));
+                _mm_storeu_ps(r,xr);
         }
+        cpxmulconj_c(p,q,r,n-i);
+}
+TARGET_AVX2 static void cpxmulconj_avx2(const float *p, const float *q,
+                                        float *r, int n)
+{
+        const __m256 sign=_mm256_setr_ps(-0.0f,0.0f,-0.0f,0.0f,
+                                         -0.0f,0.0f,-0.0f,0.0f);
+        __m256 xp,xq,xr,xi,xs;
+        int i=0;
+
+        for (; i<n-3; i+=4,p+=8,q+=8,r+=8) {
+                xp=_mm256_loadu_ps(p);
+                xq=_mm256_loadu_ps(q);
+                xr=_mm256_xor_ps(_mm256_moveldup_ps(xp),sign); /* -p0, p0 */
+                xi=_mm256_movehdup_ps(xp);                     /*  p1, p1 */
+                xs=_mm256_permute_ps(xq,0xB1);                 /*  q1, q0 */
+                xr=_mm256_fmsub_ps(xr,xq,_mm256_mul_ps(xi,xs));
+                _mm256_storeu_ps(r,xr);
+        }
+        cpxmulconj_c(p,q,r,n-i);
+}
+TARGET_AVX512 static void cpxmulconj_avx512(const float *p, const float *q,
+                                            float *r, int n)
+{
+        const __m512i sign=_mm512_set1_epi64(0x80000000); /* -0.0f, 0.0f */
+        __m512 xp,xq,xr,xi,xs;
+        int i=0;
+
+        for (; i<n-7; i+=8,p+=16,q+=16,r+=16) {
+                xp=_mm512_loadu_ps(p);
+                xq=_mm512_loadu_ps(q);
+                xr=_mm512_castsi512_ps(_mm512_xor_si512(
+                        _mm512_castps_si512(_mm512_moveldup_ps(xp)),sign));
+                xi=_mm512_movehdup_ps(xp);
+                xs=_mm512_permute_ps(xq,0xB1);
+                xr=_mm512_fmsub_ps(xr,xq,_mm512_mul_ps(xi,xs));
+                _mm512_storeu_ps(r,xr);
+        }
+        cpxmulconj_c(p,q,r,n-i);
+}
+#endif /* SSE2_ENABLE */
+static void (*cpxmulconj)(const float *p, const float *q, float *r,
+                          int n)=cpxmulconj_c;
 
-        cpxifft(iplan,cpxa,m); /* ifft */
+/* complex power accumulation -------------------------------------------------*/
+static void cpxpowacc_c(const float *r, float scale, int n, int flagsum,
+                        float *conv)
+{
+        int i;
 
         if (flagsum) { /* cumulative sum */
-                for (i=0,p=(float *)cpxa; i<n; i++,p+=2)
-                        conv[i]+=(p[0]*p[0]+p[1]*p[1])/m2;
+                for (i=0; i<n; i++,r+=2) conv[i]+=(r[0]*r[0]+r[1]*r[1])*scale;
         } else {
-                for (i=0,p=(float *)cpxa; i<n; i++,p+=2)
-                        conv[i]=(p[0]*p[0]+p[1]*p[1])/m2;
+                for (i=0; i<n; i++,r+=2) conv[i] =(r[0]*r[0]+r[1]*r[1])*scale;
+        }
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void cpxpowacc_sse2(const float *r, float scale, int n,
+                                       int flagsum, float *conv)
+{
+        const __m128 xscale=_mm_set1_ps(scale);
+        __m128 x1,x2,xp,xc;
+        int i=0;
+
+        for (; i<n-3; i+=4,r+=8) {
+                x1=_mm_loadu_ps(r);
+                x2=_mm_loadu_ps(r+4);
+                x1=_mm_mul_ps(x1,x1);
+                x2=_mm_mul_ps(x2,x2);
+                xp=_mm_add_ps(_mm_shuffle_ps(x1,x2,0x88),
+                              _mm_shuffle_ps(x1,x2,0xDD));
+                xc=_mm_mul_ps(xp,xscale);
+                if (flagsum) xc=_mm_add_ps(xc,_mm_loadu_ps(conv+i));
+                _mm_storeu_ps(conv+i,xc);
         }
+        cpxpowacc_c(r,scale,n-i,flagsum,conv+i);
+}
+TARGET_AVX2 static void cpxpowacc_avx2(const float *r, float scale, int n,
+                                       int flagsum, float *conv)
+{
+        const __m256 xscale=_mm256_set1_ps(scale);
+        __m256 x1,x2,xp,xc;
+        int i=0;
+
+        for (; i<n-7; i+=8,r+=16) {
+                x1=_mm256_loadu_ps(r);
+                x2=_mm256_loadu_ps(r+8);
+                x1=_mm256_mul_ps(x1,x1);
+                x2=_mm256_mul_ps(x2,x2);
+                xp=_mm256_hadd_ps(x1,x2); /* |r0|^2,|r1|^2,|r4|^2,|r5|^2,... */
+                xp=_mm256_castpd_ps(_mm256_permute4x64_pd(
+                        _mm256_castps_pd(xp),0xD8));
+                if (flagsum) {
+                        xc=_mm256_fmadd_ps(xp,xscale,_mm256_loadu_ps(conv+i));
+                } else {
+                        xc=_mm256_mul_ps(xp,xscale);
+                }
+                _mm256_storeu_ps(conv+i,xc);
+        }
+        cpxpowacc_c(r,scale,n-i,flagsum,conv+i);
+}
+TARGET_AVX512 static void cpxpowacc_avx512(const float *r, float scale, int n,
+                                           int flagsum, float *conv)
+{
+        const __m512 xscale=_mm512_set1_ps(scale);
+        const __m512i ire=_mm512_setr_epi32( 0, 2, 4, 6, 8,10,12,14,
+                                            16,18,20,22,24,26,28,30);
+        const __m512i iim=_mm512_setr_epi32( 1, 3, 5, 7, 9,11,13,15,
+                                            17,19,21,23,25,27,29,31);
+        __m512 x1,x2,xp,xc;
+        int i=0;
+
+        for (; i<n-15; i+=16,r+=32) {
+                x1=_mm512_loadu_ps(r);
+                x2=_mm512_loadu_ps(r+16);
+                x1=_mm512_mul_ps(x1,x1);
+                x2=_mm512_mul_ps(x2,x2);
+                xp=_mm512_add_ps(_mm512_permutex2var_ps(x1,ire,x2),
+                                 _mm512_permutex2var_ps(x1,iim,x2));
+                if (flagsum) {
+                        xc=_mm512_fmadd_ps(xp,xscale,_mm512_loadu_ps(conv+i));
+                } else {
+                        xc=_mm512_mul_ps(xp,xscale);
+                }
+                _mm512_storeu_ps(conv+i,xc);
+        }
+        cpxpowacc_c(r,scale,n-i,flagsum,conv+i);
+}
+#endif /* SSE2_ENABLE */
+static void (*cpxpowacc)(const float *r, float scale, int n, int flagsum,
+                         float *conv)=cpxpowacc_c;
+
+/* FFT convolution (frequency domain input) ------------------------------------
+* conv=sqrt(abs(ifft(circshift(cpxa,shift).*conj(cpxb))).^2)
+* args   : fftwf_plan iplan I   ifftw plan (NULL: cached plan, see fftplan)
+*          cpx_t  *cpxa     I   input complex data array (frequency domain)
+*          int    shift     I   circular shift of cpxa (frequency bins)
+*          cpx_t  *cpxb     I   input complex data array (frequency domain)
+*          int    m         I   number of input data
+*          int    n         I   number of output data
+*          int    flagsum   I   cumulative sum flag (conv+=conv)
+*          cpx_t  *work     W   work array (m x 1, may be same as cpxa if
+*                               shift=0)
+*          float  *conv     O   output convolution power
+* return : none
+* notes  : cpxa is not modified unless work==cpxa, so that one data spectrum
+*          can be correlated with several codes and doppler shifts
+*          circshift(cpxa,shift)=fft(ifft(cpxa).*e^(2*pi*shift/m*k*i))
+*-----------------------------------------------------------------------------*/
+extern void cpxconvx(fftwf_plan iplan, const cpx_t *cpxa, int shift,
+                     const cpx_t *cpxb, int m, int n, int flagsum, cpx_t *work,
+                     float *conv)
+{
+        const float *p=(const float *)cpxa,*q=(const float *)cpxb;
+        float *r=(float *)work,m2=(float)m*m;
+
+        shift%=m; if (shift<0) shift+=m;
+
+        /* work[k]=cpxa[k-shift]*conj(cpxb[k]) */
+        cpxmulconj(p+2*(m-shift),q,r,shift);
+        cpxmulconj(p,q+2*shift,r+2*shift,m-shift);
+
+        cpxifft(iplan,work,m); /* ifft */
+
+        cpxpowacc(r,1.0f/m2,n,flagsum,conv);
 }
 
 /* power spectrum calculation --------------------------------------------------
 * power spectrum: pspec=abs(fft(cpx)).^2
-* args   : fftwf_plan plan  I   fftw plan (NULL: create new plan)
+* args   : fftwf_plan plan  I   fftw plan (NULL: cached plan, see fftplan)
 *          cpx_t  *cpx      I   input complex data array
 *          int    n         I   number of input data
 *          int    flagsum   I   cumulative sum flag (pspec+=pspec)
@@ -279,7 +659,8 @@ extern void cpxpspec(fftwf_plan plan, cpx_t *cpx, int n, int flagsum,
 }
 
 /* fundamental functions using SIMD --------------------------------------------
-* note : SSE2 instructions are used
+* note : SSE2 (SSSE3), AVX2 and AVX-512 kernels are built for any x86-64 cpu
+*        and bound to the dispatched functions by simdinit
 *-----------------------------------------------------------------------------*/
 #if defined(SSE2_ENABLE)
 
@@ -332,33 +713,78 @@ extern void cpxpspec(fftwf_plan plan, cpx_t *cpx, int n, int flagsum,
                 LOAD_INT8(_x1,_x2,src,zero); \
                 MUL_INT16(dst,_x1,_x2,xmm1,xmm2); \
 }
-/* double to int32: xmm{int32}=(xmm1,xmm2){double} ---------------------------*/
-#define DBLTOINT32(xmm,xmm1,xmm2) { \
-                __m128i _int1,_int2; \
-                _int1=_mm_cvttpd_epi32(xmm1); \
-                _int2=_mm_cvttpd_epi32(xmm2); \
-                _int2=_mm_slli_si128(_int2,8); \
-                xmm=_mm_add_epi32(_int1,_int2); \
-}
-/* double to int16: xmm{int16}=(xmm1,...,xmm4){double}&mask{int32} -----------*/
-#define DBLTOINT16(xmm,xmm1,xmm2,xmm3,xmm4,mask) { \
-                __m128i _int3,_int4; \
-                DBLTOINT32(_int3,xmm1,xmm2); \
-                DBLTOINT32(_int4,xmm3,xmm4); \
-                _int3=_mm_and_si128(_int3,mask); \
-                _int4=_mm_and_si128(_int4,mask); \
-                xmm=_mm_packs_epi32(_int3,_int4); \
-}
-/* multiply int8 with lut:dst[16]{int16}=(xmm1,xmm2){int8}.*xmm3{int8}[index] */
-#define MIX_INT8(dst,xmm1,xmm2,xmm3,index,zero) { \
-                __m128i _x,_x1,_x2; \
-                _x=_mm_shuffle_epi8(xmm3,index); \
-                EXPAND_INT8(_x1,_x2,_x,zero); \
-                MUL_INT16(dst,_x1,_x2,xmm1,xmm2); \
+/* carrier nco lookup: (cs,sn){int16}=(cos,sin)[ind{int16}] (0<=ind<CDIV) -----
+* quarter cycle tables xcos,xsin{int8} are looked up by the lower 4 bits of ind,
+* swapped for odd quarters and negated by the quarter (upper 2 bits of ind) */
+#define NCO_LUT(cs,sn,ind,xcos,xsin) { \
+                __m128i _i,_s,_w,_t; \
+                _i=_mm_or_si128(ind,_mm_set1_epi16((short)0x8000)); \
+                cs=_mm_shuffle_epi8(xcos,_i); \
+                sn=_mm_shuffle_epi8(xsin,_i); \
+                _s=_mm_slli_epi16(ind,10); \
+                _w=_mm_slli_epi16(ind,11); \
+                _t=_mm_and_si128(_mm_xor_si128(cs,sn),_mm_srai_epi16(_w,15)); \
+                cs=_mm_xor_si128(cs,_t); \
+                sn=_mm_xor_si128(sn,_t); \
+                _t=_mm_srai_epi16(_mm_xor_si128(_s,_w),15); \
+                cs=_mm_sub_epi16(_mm_xor_si128(cs,_t),_t); \
+                _t=_mm_srai_epi16(_s,15); \
+                sn=_mm_sub_epi16(_mm_xor_si128(sn,_t),_t); \
+}
+/* carrier nco lookup (AVX2): (cs,sn){int16}=(cos,sin)[ind{int16}] -----------*/
+#define NCO_LUT_AVX(cs,sn,ind,xcos,xsin) { \
+                __m256i _i,_s,_w,_t; \
+                _i=_mm256_or_si256(ind,_mm256_set1_epi16((short)0x8000)); \
+                cs=_mm256_shuffle_epi8(xcos,_i); \
+                sn=_mm256_shuffle_epi8(xsin,_i); \
+                _s=_mm256_slli_epi16(ind,10); \
+                _w=_mm256_slli_epi16(ind,11); \
+                _t=_mm256_and_si256(_mm256_xor_si256(cs,sn), \
+                                    _mm256_srai_epi16(_w,15)); \
+                cs=_mm256_xor_si256(cs,_t); \
+                sn=_mm256_xor_si256(sn,_t); \
+                _t=_mm256_srai_epi16(_mm256_xor_si256(_s,_w),15); \
+                cs=_mm256_sub_epi16(_mm256_xor_si256(cs,_t),_t); \
+                _t=_mm256_srai_epi16(_s,15); \
+                sn=_mm256_sub_epi16(_mm256_xor_si256(sn,_t),_t); \
 }
-#endif /* SSE2_ENABLE */
 
-#if defined(AVX2_ENABLE)
+/* carrier mixing of int16 complex: (xI,xQ){int16}=src[8]{int16,int16}.*(cs,sn)
+* products are rounded to int16 by CSHIFT16 bits (same as mix16) */
+#define MIX_INT16C(xI,xQ,src,cs,sn) { \
+                __m128i _d1,_d2,_c1,_c2,_s1,_s2,_n,_r; \
+                _d1=_mm_loadu_si128((__m128i *)(src)); \
+                _d2=_mm_loadu_si128((__m128i *)(src)+1); \
+                _n=_mm_sub_epi16(_mm_setzero_si128(),sn); \
+                _r=_mm_set1_epi32(1<<(CSHIFT16-1)); \
+                _c1=_mm_unpacklo_epi16(cs,_n); _c2=_mm_unpackhi_epi16(cs,_n); \
+                _s1=_mm_unpacklo_epi16(sn,cs); _s2=_mm_unpackhi_epi16(sn,cs); \
+                xI=_mm_packs_epi32( \
+                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_d1,_c1),_r),CSHIFT16), \
+                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_d2,_c2),_r),CSHIFT16)); \
+                xQ=_mm_packs_epi32( \
+                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_d1,_s1),_r),CSHIFT16), \
+                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_d2,_s2),_r),CSHIFT16)); \
+}
+/* carrier mixing of int16 complex (AVX2): (xI,xQ){int16}=src[16]{int16,int16}
+* .*(cs,sn), cs,sn in 64 bit block order 0,2,1,3 (unpermuted pack) */
+#define MIX_INT16C_AVX(xI,xQ,src,cs,sn) { \
+                __m256i _d1,_d2,_c1,_c2,_s1,_s2,_n,_r; \
+                _d1=_mm256_loadu_si256((__m256i *)(src)); \
+                _d2=_mm256_loadu_si256((__m256i *)(src)+1); \
+                _n=_mm256_sub_epi16(_mm256_setzero_si256(),sn); \
+                _r=_mm256_set1_epi32(1<<(CSHIFT16-1)); \
+                _c1=_mm256_unpacklo_epi16(cs,_n); _c2=_mm256_unpackhi_epi16(cs,_n); \
+                _s1=_mm256_unpacklo_epi16(sn,cs); _s2=_mm256_unpackhi_epi16(sn,cs); \
+                xI=_mm256_packs_epi32( \
+                    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_d1,_c1),_r),CSHIFT16), \
+                    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_d2,_c2),_r),CSHIFT16)); \
+                xQ=_mm256_packs_epi32( \
+                    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_d1,_s1),_r),CSHIFT16), \
+                    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_d2,_s2),_r),CSHIFT16)); \
+                xI=_mm256_permute4x64_epi64(xI,0xD8); \
+                xQ=_mm256_permute4x64_epi64(xQ,0xD8); \
+}
 
 /* multiply and add: xmm256{int32}+=src1[16]{int16}.*src2[16]{int16} ---------*/
 #define MULADD_INT16_AVX(xmm,src1,src2) { \
@@ -374,7 +800,7 @@ extern void cpxpspec(fftwf_plan plan, cpx_t *cpx, int n, int flagsum,
                 _mm256_storeu_si256((__m256i *)_sum,xmm); \
                 dst=_sum[0]+_sum[1]+_sum[2]+_sum[3]+_sum[4]+_sum[5]+_sum[6]+_sum[7]; \
 }
-#endif /* AVX2_ENABLE */
+#endif /* SSE2_ENABLE */
 
 /* dot products: d1=dot(a1,b),d2=dot(a2,b) -------------------------------------
 * args   : short  *a1       I   input short array
@@ -385,27 +811,26 @@ extern void cpxpspec(fftwf_plan plan, cpx_t *cpx, int n, int flagsum,
 *          double *d2       O   output short array
 * return : none
 * notes  : -128<=a1[i],a2[i],b[i]<127
+*          SIMD kernels process multiples of 8 (SSE2) or 16 (AVX2) data
 *-----------------------------------------------------------------------------*/
-extern void dot_21(const short *a1, const short *a2, const short *b, int n,
-                   double *d1, double *d2)
+static void dot_21_c(const short *a1, const short *a2, const short *b, int n,
+                     double *d1, double *d2)
 {
         const short *p1=a1,*p2=a2,*q=b;
 
-#if defined(AVX2_ENABLE)
-        __m256i xmm1,xmm2;
-
-        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
-        xmm1=_mm256_setzero_si256();
-        xmm2=_mm256_setzero_si256();
+        d1[0]=d2[0]=0.0;
 
-        for (; p1<a1+n; p1+=16,p2+=16,q+=16) {
-                MULADD_INT16_AVX(xmm1,p1,q);
-                MULADD_INT16_AVX(xmm2,p2,q);
+        for (; p1<a1+n; p1++,p2++,q++) {
+                d1[0]+=(*p1)*(*q);
+                d2[0]+=(*p2)*(*q);
         }
-        SUM_INT32_AVX(d1[0],xmm1);
-        SUM_INT32_AVX(d2[0],xmm2);
-
-#elif defined(SSE2_ENABLE)
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void dot_21_sse2(const short *a1, const short *a2,
+                                    const short *b, int n, double *d1,
+                                    double *d2)
+{
+        const short *p1=a1,*p2=a2,*q=b;
         __m128i xmm1,xmm2;
 
         n=8*(int)ceil((double)n/8); /* modification to multiples of 8 */
@@ -418,15 +843,33 @@ extern void dot_21(const short *a1, const short *a2, const short *b, int n,
         }
         SUM_INT32(d1[0],xmm1);
         SUM_INT32(d2[0],xmm2);
+}
+TARGET_AVX2 static void dot_21_avx2(const short *a1, const short *a2,
+                                    const short *b, int n, double *d1,
+                                    double *d2)
+{
+        const short *p1=a1,*p2=a2,*q=b;
+        __m256i xmm1,xmm2;
 
-#else
-        d1[0]=d2[0]=0.0;
+        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
+        xmm1=_mm256_setzero_si256();
+        xmm2=_mm256_setzero_si256();
 
-        for (; p1<a1+n; p1++,p2++,q++) {
-                d1[0]+=(*p1)*(*q);
-                d2[0]+=(*p2)*(*q);
+        for (; p1<a1+n; p1+=16,p2+=16,q+=16) {
+                MULADD_INT16_AVX(xmm1,p1,q);
+                MULADD_INT16_AVX(xmm2,p2,q);
         }
-#endif
+        SUM_INT32_AVX(d1[0],xmm1);
+        SUM_INT32_AVX(d2[0],xmm2);
+}
+#endif /* SSE2_ENABLE */
+static void (*dot_21_f)(const short *a1, const short *a2, const short *b,
+                        int n, double *d1, double *d2)=dot_21_c;
+
+extern void dot_21(const short *a1, const short *a2, const short *b, int n,
+                   double *d1, double *d2)
+{
+        dot_21_f(a1,a2,b,n,d1,d2);
 }
 
 /* dot products: d1={dot(a1,b1),dot(a1,b2)},d2={dot(a2,b1),dot(a2,b2)} ---------
@@ -439,32 +882,26 @@ extern void dot_21(const short *a1, const short *a2, const short *b, int n,
 *          short  *d2       O   output short array
 * return : none
 *-----------------------------------------------------------------------------*/
-extern void dot_22(const short *a1, const short *a2, const short *b1,
-                   const short *b2, int n, double *d1, double *d2)
+static void dot_22_c(const short *a1, const short *a2, const short *b1,
+                     const short *b2, int n, double *d1, double *d2)
 {
         const short *p1=a1,*p2=a2,*q1=b1,*q2=b2;
 
-#if defined(AVX2_ENABLE)
-        __m256i xmm1,xmm2,xmm3,xmm4;
-
-        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
-        xmm1=_mm256_setzero_si256();
-        xmm2=_mm256_setzero_si256();
-        xmm3=_mm256_setzero_si256();
-        xmm4=_mm256_setzero_si256();
+        d1[0]=d1[1]=d2[0]=d2[1]=0.0;
 
-        for (; p1<a1+n; p1+=16,p2+=16,q1+=16,q2+=16) {
-                MULADD_INT16_AVX(xmm1,p1,q1);
-                MULADD_INT16_AVX(xmm2,p1,q2);
-                MULADD_INT16_AVX(xmm3,p2,q1);
-                MULADD_INT16_AVX(xmm4,p2,q2);
+        for (; p1<a1+n; p1++,p2++,q1++,q2++) {
+                d1[0]+=(*p1)*(*q1);
+                d1[1]+=(*p1)*(*q2);
+                d2[0]+=(*p2)*(*q1);
+                d2[1]+=(*p2)*(*q2);
         }
-        SUM_INT32_AVX(d1[0],xmm1);
-        SUM_INT32_AVX(d1[1],xmm2);
-        SUM_INT32_AVX(d2[0],xmm3);
-        SUM_INT32_AVX(d2[1],xmm4);
-
-#elif defined(SSE2_ENABLE)
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void dot_22_sse2(const short *a1, const short *a2,
+                                    const short *b1, const short *b2, int n,
+                                    double *d1, double *d2)
+{
+        const short *p1=a1,*p2=a2,*q1=b1,*q2=b2;
         __m128i xmm1,xmm2,xmm3,xmm4;
 
         n=8*(int)ceil((double)n/8); /* modification to multiples of 8 */
@@ -483,17 +920,40 @@ extern void dot_22(const short *a1, const short *a2, const short *b1,
         SUM_INT32(d1[1],xmm2);
         SUM_INT32(d2[0],xmm3);
         SUM_INT32(d2[1],xmm4);
+}
+TARGET_AVX2 static void dot_22_avx2(const short *a1, const short *a2,
+                                    const short *b1, const short *b2, int n,
+                                    double *d1, double *d2)
+{
+        const short *p1=a1,*p2=a2,*q1=b1,*q2=b2;
+        __m256i xmm1,xmm2,xmm3,xmm4;
 
-#else
-        d1[0]=d1[1]=d2[0]=d2[1]=0.0;
+        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
+        xmm1=_mm256_setzero_si256();
+        xmm2=_mm256_setzero_si256();
+        xmm3=_mm256_setzero_si256();
+        xmm4=_mm256_setzero_si256();
 
-        for (; p1<a1+n; p1++,p2++,q1++,q2++) {
-                d1[0]+=(*p1)*(*q1);
-                d1[1]+=(*p1)*(*q2);
-                d2[0]+=(*p2)*(*q1);
-                d2[1]+=(*p2)*(*q2);
+        for (; p1<a1+n; p1+=16,p2+=16,q1+=16,q2+=16) {
+                MULADD_INT16_AVX(xmm1,p1,q1);
+                MULADD_INT16_AVX(xmm2,p1,q2);
+                MULADD_INT16_AVX(xmm3,p2,q1);
+                MULADD_INT16_AVX(xmm4,p2,q2);
         }
-#endif
+        SUM_INT32_AVX(d1[0],xmm1);
+        SUM_INT32_AVX(d1[1],xmm2);
+        SUM_INT32_AVX(d2[0],xmm3);
+        SUM_INT32_AVX(d2[1],xmm4);
+}
+#endif /* SSE2_ENABLE */
+static void (*dot_22_f)(const short *a1, const short *a2, const short *b1,
+                        const short *b2, int n, double *d1,
+                        double *d2)=dot_22_c;
+
+extern void dot_22(const short *a1, const short *a2, const short *b1,
+                   const short *b2, int n, double *d1, double *d2)
+{
+        dot_22_f(a1,a2,b1,b2,n,d1,d2);
 }
 
 /* dot products: d1={dot(a1,b1),dot(a1,b2),dot(a1,b3)},d2={...} ----------------
@@ -507,39 +967,30 @@ extern void dot_22(const short *a1, const short *a2, const short *b1,
 *          short  *d2       O   output short array
 * return : none
 *-----------------------------------------------------------------------------*/
-extern void dot_23(const short *a1, const short *a2, const short *b1,
-                   const short *b2, const short *b3, int n, double *d1,
-                   double *d2)
+static void dot_23_c(const short *a1, const short *a2, const short *b1,
+                     const short *b2, const short *b3, int n, double *d1,
+                     double *d2)
 {
         const short *p1=a1,*p2=a2,*q1=b1,*q2=b2,*q3=b3;
 
-#if defined(AVX2_ENABLE)
-        __m256i xmm1,xmm2,xmm3,xmm4,xmm5,xmm6;
-
-        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
-        xmm1=_mm256_setzero_si256();
-        xmm2=_mm256_setzero_si256();
-        xmm3=_mm256_setzero_si256();
-        xmm4=_mm256_setzero_si256();
-        xmm5=_mm256_setzero_si256();
-        xmm6=_mm256_setzero_si256();
+        d1[0]=d1[1]=d1[2]=d2[0]=d2[1]=d2[2]=0.0;
 
-        for (; p1<a1+n; p1+=16,p2+=16,q1+=16,q2+=16,q3+=16) {
-                MULADD_INT16_AVX(xmm1,p1,q1);
-                MULADD_INT16_AVX(xmm2,p1,q2);
-                MULADD_INT16_AVX(xmm3,p1,q3);
-                MULADD_INT16_AVX(xmm4,p2,q1);
-                MULADD_INT16_AVX(xmm5,p2,q2);
-                MULADD_INT16_AVX(xmm6,p2,q3);
+        for (; p1<a1+n; p1++,p2++,q1++,q2++,q3++) {
+                d1[0]+=(*p1)*(*q1);
+                d1[1]+=(*p1)*(*q2);
+                d1[2]+=(*p1)*(*q3);
+                d2[0]+=(*p2)*(*q1);
+                d2[1]+=(*p2)*(*q2);
+                d2[2]+=(*p2)*(*q3);
         }
-        SUM_INT32_AVX(d1[0],xmm1);
-        SUM_INT32_AVX(d1[1],xmm2);
-        SUM_INT32_AVX(d1[2],xmm3);
-        SUM_INT32_AVX(d2[0],xmm4);
-        SUM_INT32_AVX(d2[1],xmm5);
-        SUM_INT32_AVX(d2[2],xmm6);
-
-#elif defined(SSE2_ENABLE)
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void dot_23_sse2(const short *a1, const short *a2,
+                                    const short *b1, const short *b2,
+                                    const short *b3, int n, double *d1,
+                                    double *d2)
+{
+        const short *p1=a1,*p2=a2,*q1=b1,*q2=b2,*q3=b3;
         __m128i xmm1,xmm2,xmm3,xmm4,xmm5,xmm6;
 
         n=8*(int)ceil((double)n/8); /* modification to multiples of 8 */
@@ -564,19 +1015,48 @@ extern void dot_23(const short *a1, const short *a2, const short *b1,
         SUM_INT32(d2[0],xmm4);
         SUM_INT32(d2[1],xmm5);
         SUM_INT32(d2[2],xmm6);
+}
+TARGET_AVX2 static void dot_23_avx2(const short *a1, const short *a2,
+                                    const short *b1, const short *b2,
+                                    const short *b3, int n, double *d1,
+                                    double *d2)
+{
+        const short *p1=a1,*p2=a2,*q1=b1,*q2=b2,*q3=b3;
+        __m256i xmm1,xmm2,xmm3,xmm4,xmm5,xmm6;
 
-#else
-        d1[0]=d1[1]=d1[2]=d2[0]=d2[1]=d2[2]=0.0;
+        n=16*(int)ceil((double)n/16); /* modification to multiples of 16 */
+        xmm1=_mm256_setzero_si256();
+        xmm2=_mm256_setzero_si256();
+        xmm3=_mm256_setzero_si256();
+        xmm4=_mm256_setzero_si256();
+        xmm5=_mm256_setzero_si256();
+        xmm6=_mm256_setzero_si256();
 
-        for (; p1<a1+n; p1++,p2++,q1++,q2++,q3++) {
-                d1[0]+=(*p1)*(*q1);
-                d1[1]+=(*p1)*(*q2);
-                d1[2]+=(*p1)*(*q3);
-                d2[0]+=(*p2)*(*q1);
-                d2[1]+=(*p2)*(*q2);
-                d2[2]+=(*p2)*(*q3);
+        for (; p1<a1+n; p1+=16,p2+=16,q1+=16,q2+=16,q3+=16) {
+                MULADD_INT16_AVX(xmm1,p1,q1);
+                MULADD_INT16_AVX(xmm2,p1,q2);
+                MULADD_INT16_AVX(xmm3,p1,q3);
+                MULADD_INT16_AVX(xmm4,p2,q1);
+                MULADD_INT16_AVX(xmm5,p2,q2);
+                MULADD_INT16_AVX(xmm6,p2,q3);
         }
-#endif
+        SUM_INT32_AVX(d1[0],xmm1);
+        SUM_INT32_AVX(d1[1],xmm2);
+        SUM_INT32_AVX(d1[2],xmm3);
+        SUM_INT32_AVX(d2[0],xmm4);
+        SUM_INT32_AVX(d2[1],xmm5);
+        SUM_INT32_AVX(d2[2],xmm6);
+}
+#endif /* SSE2_ENABLE */
+static void (*dot_23_f)(const short *a1, const short *a2, const short *b1,
+                        const short *b2, const short *b3, int n, double *d1,
+                        double *d2)=dot_23_c;
+
+extern void dot_23(const short *a1, const short *a2, const short *b1,
+                   const short *b2, const short *b3, int n, double *d1,
+                   double *d2)
+{
+        dot_23_f(a1,a2,b1,b2,b3,n,d1,d2);
 }
 
 /* multiply char/short vectors -------------------------------------------------
@@ -600,30 +1080,35 @@ extern void mulvcs(const char *data1, const short *data2, int n, short *out)
 *          int    n         I   number of input data
 *          float  *out      O   output float array
 * return : none
-* note   : AVX command is used if "AVX" is defined
+* note   : AVX kernel is used if selected by simdinit
 *-----------------------------------------------------------------------------*/
-extern void sumvf(const float *data1, const float *data2, int n, float *out)
+static void sumvf_c(const float *data1, const float *data2, int n, float *out)
 {
         int i;
-#if !defined(AVX_ENABLE)
         for (i=0; i<n; i++) out[i]=data1[i]+data2[i];
-#else
-        int m=n/8;
+}
+#if defined(SSE2_ENABLE)
+TARGET_AVX2 static void sumvf_avx(const float *data1, const float *data2,
+                                  int n, float *out)
+{
+        int i,m=n/8;
         __m256 xmm1,xmm2,xmm3;
 
-        if (n<8) {
-                for (i=0; i<n; i++) out[i]=data1[i]+data2[i];
-        }
-        else {
-                for (i=0; i<8*m; i+=8) {
-                        xmm1=_mm256_loadu_ps(&data1[i]);
-                        xmm2=_mm256_loadu_ps(&data2[i]);
-                        xmm3=_mm256_add_ps(xmm1,xmm2);
-                        _mm256_storeu_ps(&out[i],xmm3);
-                }
-                for (; i<n; i++) out[i]=data1[i]+data2[i];
+        for (i=0; i<8*m; i+=8) {
+                xmm1=_mm256_loadu_ps(&data1[i]);
+                xmm2=_mm256_loadu_ps(&data2[i]);
+                xmm3=_mm256_add_ps(xmm1,xmm2);
+                _mm256_storeu_ps(&out[i],xmm3);
         }
-#endif
+        for (; i<n; i++) out[i]=data1[i]+data2[i];
+}
+#endif /* SSE2_ENABLE */
+static void (*sumvf_f)(const float *data1, const float *data2, int n,
+                       float *out)=sumvf_c;
+
+extern void sumvf(const float *data1, const float *data2, int n, float *out)
+{
+        sumvf_f(data1,data2,n,out);
 }
 
 /* sum double vectors ----------------------------------------------------------
@@ -633,30 +1118,36 @@ extern void sumvf(const float *data1, const float *data2, int n, float *out)
 *          int    n         I   number of input data
 *          double *out      O   output double array
 * return : none
-* note   : AVX command is used if "AVX" is defined
+* note   : AVX kernel is used if selected by simdinit
 *-----------------------------------------------------------------------------*/
-extern void sumvd(const double *data1, const double *data2, int n, double *out)
+static void sumvd_c(const double *data1, const double *data2, int n,
+                    double *out)
 {
         int i;
-#if !defined(AVX_ENABLE)
         for (i=0; i<n; i++) out[i]=data1[i]+data2[i];
-#else
-        int m=n/4;
+}
+#if defined(SSE2_ENABLE)
+TARGET_AVX2 static void sumvd_avx(const double *data1, const double *data2,
+                                  int n, double *out)
+{
+        int i,m=n/4;
         __m256d xmm1,xmm2,xmm3;
 
-        if (n<8) {
-                for (i=0; i<n; i++) out[i]=data1[i]+data2[i];
-        }
-        else {
-                for (i=0; i<4*m; i+=4) {
-                        xmm1=_mm256_loadu_pd(&data1[i]);
-                        xmm2=_mm256_loadu_pd(&data2[i]);
-                        xmm3=_mm256_add_pd(xmm1,xmm2);
-                        _mm256_storeu_pd(&out[i],xmm3);
-                }
-                for (; i<n; i++) out[i]=data1[i]+data2[i];
+        for (i=0; i<4*m; i+=4) {
+                xmm1=_mm256_loadu_pd(&data1[i]);
+                xmm2=_mm256_loadu_pd(&data2[i]);
+                xmm3=_mm256_add_pd(xmm1,xmm2);
+                _mm256_storeu_pd(&out[i],xmm3);
         }
-#endif
+        for (; i<n; i++) out[i]=data1[i]+data2[i];
+}
+#endif /* SSE2_ENABLE */
+static void (*sumvd_f)(const double *data1, const double *data2, int n,
+                       double *out)=sumvd_c;
+
+extern void sumvd(const double *data1, const double *data2, int n, double *out)
+{
+        sumvd_f(data1,data2,n,out);
 }
 
 /* maximum value and index (int array) -----------------------------------------
@@ -743,6 +1234,28 @@ extern double maxvd(const double *data, int n, int exinds, int exinde, int *ind)
         return max;
 }
 
+/* mean value (float array) ----------------------------------------------------
+* calculate mean value
+* args   : float  *data     I   input float array
+*          int    n         I   number of input data
+*          int    exinds    I   exception index (start)
+*          int    exinde    I   exception index (end)
+* return : float                mean value
+* note   : mean value is calculated without exinds-exinde index
+*          exinds=exinde=-1: use all data
+*-----------------------------------------------------------------------------*/
+extern float meanvf(const float *data, int n, int exinds, int exinde)
+{
+        int i,ne=0;
+        double mean=0.0;
+        for(i=0; i<n; i++) {
+                if ((exinds<=exinde)&&(i<exinds||i>exinde)) mean+=data[i];
+                else if ((exinds>exinde)&&(i<exinds&&i>exinde)) mean+=data[i];
+                else ne++;
+        }
+        return (float)(mean/(n-ne));
+}
+
 /* mean value (double array) ---------------------------------------------------
 * calculate mean value
 * args   : double *data     I   input double array
@@ -859,13 +1372,7 @@ extern void ind2sub(int ind, int nx, int ny, int *subx, int *suby)
 *-----------------------------------------------------------------------------*/
 extern void shiftdata(void *dst, void *src, size_t size, int n)
 {
-        void *tmp;
-        tmp=malloc(size*n);
-        if (tmp!=NULL) {
-                memcpy(tmp,src,size*n);
-                memcpy(dst,tmp,size*n);
-                free(tmp);
-        }
+        memmove(dst,src,size*n);
 }
 
 /* resample code ---------------------------------------------------------------
@@ -879,12 +1386,11 @@ extern void shiftdata(void *dst, void *src, size_t size, int n)
 *          short  *rcode    O   resampling code
 * return : double               code remainder
 *-----------------------------------------------------------------------------*/
-extern double rescode(const short *code, int len, double coff, int smax,
-                      double ci, int n, short *rcode)
+static double rescode_c(const short *code, int len, double coff, int smax,
+                        double ci, int n, short *rcode)
 {
         short *p;
 
-#if !defined(SSE2_ENABLE)
         coff-=smax*ci;
         coff-=floor(coff/len)*len; /* 0<=coff<len */
 
@@ -893,8 +1399,12 @@ extern double rescode(const short *code, int len, double coff, int smax,
                 *p=code[(int)coff];
         }
         return coff-smax*ci;
-
-#else
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static double rescode_sse2(const short *code, int len, double coff,
+                                       int smax, double ci, int n, short *rcode)
+{
+        short *p;
         int i,index[4],x[4],nbit,scale;
         __m128i xmm1,xmm2,xmm3,xmm4,xmm5;
 
@@ -929,142 +1439,548 @@ extern double rescode(const short *code, int len, double coff, int smax,
         coff+=ci*(n+2*smax)-4*ci;
         coff-=floor(coff/len)*len;
         return coff-smax*ci;
-#endif
+}
+#endif /* SSE2_ENABLE */
+static double (*rescode_f)(const short *code, int len, double coff, int smax,
+                           double ci, int n, short *rcode)=rescode_c;
+
+extern double rescode(const short *code, int len, double coff, int smax,
+                      double ci, int n, short *rcode)
+{
+        return rescode_f(code,len,coff,smax,ci,n,rcode);
+}
+
+/* generate code replica bank --------------------------------------------------
+* pre-sample code at nominal rate with fractional sample phase offsets
+* args   : short  *code     I   code
+*          int    len       I   code length (chip)
+*          double ci        I   nominal code sampling interval (chip)
+*          int    smax      I   maximum correlator space (sample)
+*          int    nph       I   number of fractional phases per sample
+*          double drift     I   max code drift in a block (sample)
+*          sdrcbank_t *bank O   code replica bank
+* return : int                  0:okay -1:error
+* notes  : replica k is code[floor((j+k/nph)*ci)%len] (j=0,1,...) and covers
+*          one code period plus one correlator block (CORRBLK+2*smax), so any
+*          block starts at a contiguous position of one of the replicas
+*          (see codebank())
+*-----------------------------------------------------------------------------*/
+extern int gencodebank(const short *code, int len, double ci, int smax,
+                       int nph, double drift, sdrcbank_t *bank)
+{
+        short *p;
+        int j,k;
+
+        memset(bank,0,sizeof(sdrcbank_t));
+        if (nph<=0) return 0;
+        if (nph>MAXCBPHASE) nph=MAXCBPHASE;
+
+        /* replica length (multiple of cache line) */
+        bank->len=(int)(len/ci)+2+CORRBLK+2*smax;
+        bank->len=(bank->len+SDRALIGN/2-1)/(SDRALIGN/2)*(SDRALIGN/2);
+
+        if (!(bank->code=(short *)sdrmalloc(sizeof(short)*nph*bank->len))) {
+                return -1;
+        }
+        for (k=0; k<nph; k++) {
+                p=bank->code+(size_t)k*bank->len;
+                for (j=0; j<bank->len; j++) {
+                        p[j]=code[(int)((j+(double)k/nph)*ci)%len];
+                }
+        }
+        bank->nph=nph;
+        bank->smax=smax;
+        bank->clen=len;
+        bank->ci=ci;
+        bank->drift=drift>0.0?drift:TRKCBDRIFT;
+        return 0;
+}
+/* free code replica bank ------------------------------------------------------
+* free code replica bank
+* args   : sdrcbank_t *bank I/O code replica bank
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void freecodebank(sdrcbank_t *bank)
+{
+        sdrfree(bank->code);
+        bank->code=NULL;
+        bank->nph=0;
+}
+/* nearest code replica of a block ---------------------------------------------
+* select replica for code offset coff and return code_e of the block
+* (same layout as rescode output, n+2*smax samples)
+* return : short *              code_e of the block (NULL: resample by rescode)
+*-----------------------------------------------------------------------------*/
+static const short *codebank(const sdrcbank_t *bank, double coff, int smax,
+                             double ci, int n)
+{
+        double u;
+        int j,k;
+
+        if (!bank||!bank->nph||smax>bank->smax||n>CORRBLK||
+            (n+2*smax)*fabs(ci-bank->ci)>bank->drift*bank->ci) {
+                return NULL;
+        }
+        u=coff-smax*ci;
+        u-=floor(u/bank->clen)*bank->clen; /* 0<=u<len */
+        u/=bank->ci; /* sample */
+
+        j=(int)u;
+        k=(int)((u-j)*bank->nph+0.5);
+        if (k>=bank->nph) {k-=bank->nph; j++;}
+
+        return bank->code+(size_t)k*bank->len+j;
+}
+
+/* carrier nco ------------------------------------------------------------------
+* local carrier is generated by a 32 bit phase accumulator (2^32=1 cycle) and
+* CDIV entry tables indexed by the upper bits of the phase. the full tables
+* are built from quarter cycle tables by symmetry, so that the SIMD lookup
+* (NCO_LUT) gives the same values as the scalar one
+*-----------------------------------------------------------------------------*/
+static short ncocos[CDIV],ncosin[CDIV]; /* carrier table */
+static char ncocosq[CDIV/4],ncosinq[CDIV/4]; /* quarter cycle table */
+
+static void ncoinit(void)
+{
+        int i;
+
+        for (i=0; i<CDIV/4; i++) {
+                ncocosq[i]=(char)floor(cos(DPI/CDIV*i)*CAMP+0.5);
+                ncosinq[i]=(char)floor(sin(DPI/CDIV*i)*CAMP+0.5);
+        }
+        for (i=0; i<CDIV/4; i++) {
+                ncocos[i         ]= ncocosq[i]; ncosin[i         ]= ncosinq[i];
+                ncocos[i+CDIV/4  ]=-ncosinq[i]; ncosin[i+CDIV/4  ]= ncocosq[i];
+                ncocos[i+CDIV/2  ]=-ncocosq[i]; ncosin[i+CDIV/2  ]=-ncosinq[i];
+                ncocos[i+CDIV*3/4]= ncosinq[i]; ncosin[i+CDIV*3/4]=-ncocosq[i];
+        }
+}
+/* nco phase (2^32=1 cycle) of carrier phase (rad) ---------------------------*/
+static uint32_t ncophase(double phi)
+{
+        phi/=DPI;
+        return (uint32_t)(int64_t)floor((phi-floor(phi))*4294967296.0+0.5);
+}
+/* nco phase step of carrier frequency (Hz) ----------------------------------*/
+static uint32_t ncostep(double freq, double ti)
+{
+        return (uint32_t)(int64_t)floor(freq*ti*4294967296.0+0.5);
+}
+/* carrier phase (rad) of nco phase ------------------------------------------*/
+static double ncorem(uint32_t phi)
+{
+        return phi*(DPI/4294967296.0);
+}
+
+/* carrier mixed int16 sample (rounded and saturated as MIX_INT16C) ---------*/
+static short mix16(int x)
+{
+        x=(x+(1<<(CSHIFT16-1)))>>CSHIFT16;
+        return (short)(x<-32768?-32768:(x>32767?32767:x));
 }
 
 /* mix local carrier -----------------------------------------------------------
 * mix local carrier to data
 * args   : char   *data     I   data
-*          int    dtype     I   data type (0:real,1:complex)
+*          int    dtype     I   data type (DTYPEI, DTYPEIQ or DTYPEIQ16)
 *          double ti        I   sampling interval (s)
 *          int    n         I   number of samples
 *          double freq      I   carrier frequency (Hz)
 *          double phi0      I   initial phase (rad)
 *          short  *I,*Q     O   carrier mixed data I, Q component
-* return : double               phase remainder
+* return : double               phase remainder (phase of the nco after n
+*                               samples, 0<=remainder<2*PI)
+* notes  : SIMD versions write I,Q up to a multiple of the vector width
+*          DTYPEIQ16 data are mixed to int16 by CSHIFT16 bits (see MIXSCALE)
 *-----------------------------------------------------------------------------*/
-extern double mixcarr(const char *data, int dtype, double ti, int n,
-                      double freq, double phi0, short *II, short *QQ)
+static double mixcarr_c(const char *data, int dtype, double ti, int n,
+                        double freq, double phi0, short *II, short *QQ)
 {
         const char *p;
-        double phi,ps,prem;
-
-#if !defined(SSE2_ENABLE)
-        static short cost[CDIV]={0},sint[CDIV]={0};
+        const short *q=(const short *)data;
+        uint32_t phi=ncophase(phi0),ps=ncostep(freq,ti);
         int i,index;
 
         /* initialize local carrier table */
-        if (!cost[0]) {
-                for (i=0; i<CDIV; i++) {
-                        cost[i]=(short)floor((cos(DPI/CDIV*i)/CSCALE+0.5));
-                        sint[i]=(short)floor((sin(DPI/CDIV*i)/CSCALE+0.5));
+        if (!ncocos[0]) ncoinit();
+
+        if (dtype==DTYPEIQ16) { /* complex int16 */
+                for (i=0; i<n; i++,phi+=ps) {
+                        index=phi>>CBITS;
+                        II[i]=mix16(ncocos[index]*q[2*i]-ncosin[index]*q[2*i+1]);
+                        QQ[i]=mix16(ncosin[index]*q[2*i]+ncocos[index]*q[2*i+1]);
                 }
         }
-        phi=phi0*CDIV/DPI;
-        ps=freq*CDIV*ti; /* phase step */
-
         if (dtype==DTYPEIQ) { /* complex */
                 for (p=data; p<data+n*2; p+=2,II++,QQ++,phi+=ps) {
-                        index=((int)phi)&CMASK;
-                        *II=cost[index]*p[0]-sint[index]*p[1];
-                        *QQ=sint[index]*p[0]+cost[index]*p[1];
+                        index=phi>>CBITS;
+                        *II=ncocos[index]*p[0]-ncosin[index]*p[1];
+                        *QQ=ncosin[index]*p[0]+ncocos[index]*p[1];
                 }
         }
         if (dtype==DTYPEI) { /* real */
                 for (p=data; p<data+n; p++,II++,QQ++,phi+=ps) {
-                        index=((int)phi)&CMASK;
-                        *II=cost[index]*p[0];
-                        *QQ=sint[index]*p[0];
+                        index=phi>>CBITS;
+                        *II=ncocos[index]*p[0];
+                        *QQ=ncosin[index]*p[0];
                 }
         }
-        prem=phi*DPI/CDIV;
-        while(prem>DPI) prem-=DPI;
-        return prem;
-#else
-        static char cost[16]={0},sint[16]={0};
-        short I1[16]={0},I2[16]={0},Q1[16]={0},Q2[16]={0};
+        return ncorem(phi);
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static double mixcarr_sse2(const char *data, int dtype, double ti,
+                                       int n, double freq, double phi0,
+                                       short *II, short *QQ)
+{
+        uint32_t phi=ncophase(phi0),ps=ncostep(freq,ti);
+        __m128i xcos,xsin,ph1,ph2,step,ind,dat,re,im,cs,sn;
+        __m128i zero=_mm_setzero_si128();
+        int i;
+
+        xcos=_mm_loadu_si128((__m128i *)ncocosq);
+        xsin=_mm_loadu_si128((__m128i *)ncosinq);
+        ph1=_mm_setr_epi32(phi,phi+ps,phi+2*ps,phi+3*ps);
+        ph2=_mm_add_epi32(ph1,_mm_set1_epi32(4*ps));
+        step=_mm_set1_epi32(8*ps);
+
+        for (i=0; i<n; i+=8) {
+                ind=_mm_packs_epi32(_mm_srli_epi32(ph1,CBITS),
+                                    _mm_srli_epi32(ph2,CBITS));
+                NCO_LUT(cs,sn,ind,xcos,xsin);
+
+                if (dtype==DTYPEIQ16) { /* complex int16 */
+                        MIX_INT16C(re,im,data+4*i,cs,sn);
+                        _mm_storeu_si128((__m128i *)(II+i),re);
+                        _mm_storeu_si128((__m128i *)(QQ+i),im);
+                } else if (dtype==DTYPEIQ) { /* complex */
+                        dat=_mm_loadu_si128((__m128i *)(data+2*i));
+                        re=_mm_srai_epi16(_mm_slli_epi16(dat,8),8);
+                        im=_mm_srai_epi16(dat,8);
+                        _mm_storeu_si128((__m128i *)(II+i),
+                                         _mm_sub_epi16(_mm_mullo_epi16(cs,re),
+                                                       _mm_mullo_epi16(sn,im)));
+                        _mm_storeu_si128((__m128i *)(QQ+i),
+                                         _mm_add_epi16(_mm_mullo_epi16(sn,re),
+                                                       _mm_mullo_epi16(cs,im)));
+                } else { /* real */
+                        dat=_mm_loadl_epi64((__m128i *)(data+i));
+                        re=_mm_srai_epi16(_mm_unpacklo_epi8(zero,dat),8);
+                        _mm_storeu_si128((__m128i *)(II+i),
+                                         _mm_mullo_epi16(cs,re));
+                        _mm_storeu_si128((__m128i *)(QQ+i),
+                                         _mm_mullo_epi16(sn,re));
+                }
+                ph1=_mm_add_epi32(ph1,step);
+                ph2=_mm_add_epi32(ph2,step);
+        }
+        return ncorem(phi+(uint32_t)n*ps);
+}
+TARGET_AVX2 static double mixcarr_avx2(const char *data, int dtype, double ti,
+                                       int n, double freq, double phi0,
+                                       short *II, short *QQ)
+{
+        uint32_t phi=ncophase(phi0),ps=ncostep(freq,ti);
+        __m256i xcos,xsin,ph1,ph2,step,ind,dat,re,im,cs,sn;
         int i;
-        __m128d xmm1,xmm2,xmm3,xmm4,xmm5,xmm6,xmm7,xmm8,xmm9;
-        __m128i dat1,dat2,dat3,dat4,ind1,ind2,xcos,xsin;
+
+        xcos=_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)ncocosq));
+        xsin=_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)ncosinq));
+        ph1=_mm256_setr_epi32(phi,phi+ps,phi+2*ps,phi+3*ps,
+                              phi+4*ps,phi+5*ps,phi+6*ps,phi+7*ps);
+        ph2=_mm256_add_epi32(ph1,_mm256_set1_epi32(8*ps));
+        step=_mm256_set1_epi32(16*ps);
+
+        for (i=0; i<n; i+=16) {
+                ind=_mm256_packus_epi32(_mm256_srli_epi32(ph1,CBITS),
+                                        _mm256_srli_epi32(ph2,CBITS));
+                if (dtype!=DTYPEIQ16) ind=_mm256_permute4x64_epi64(ind,0xD8);
+                NCO_LUT_AVX(cs,sn,ind,xcos,xsin);
+
+                if (dtype==DTYPEIQ16) { /* complex int16 */
+                        MIX_INT16C_AVX(re,im,data+4*i,cs,sn);
+                        _mm256_storeu_si256((__m256i *)(II+i),re);
+                        _mm256_storeu_si256((__m256i *)(QQ+i),im);
+                } else if (dtype==DTYPEIQ) { /* complex */
+                        dat=_mm256_loadu_si256((__m256i *)(data+2*i));
+                        re=_mm256_srai_epi16(_mm256_slli_epi16(dat,8),8);
+                        im=_mm256_srai_epi16(dat,8);
+                        _mm256_storeu_si256((__m256i *)(II+i),
+                                _mm256_sub_epi16(_mm256_mullo_epi16(cs,re),
+                                                 _mm256_mullo_epi16(sn,im)));
+                        _mm256_storeu_si256((__m256i *)(QQ+i),
+                                _mm256_add_epi16(_mm256_mullo_epi16(sn,re),
+                                                 _mm256_mullo_epi16(cs,im)));
+                } else { /* real */
+                        re=_mm256_cvtepi8_epi16(
+                                _mm_loadu_si128((__m128i *)(data+i)));
+                        _mm256_storeu_si256((__m256i *)(II+i),
+                                            _mm256_mullo_epi16(cs,re));
+                        _mm256_storeu_si256((__m256i *)(QQ+i),
+                                            _mm256_mullo_epi16(sn,re));
+                }
+                ph1=_mm256_add_epi32(ph1,step);
+                ph2=_mm256_add_epi32(ph2,step);
+        }
+        return ncorem(phi+(uint32_t)n*ps);
+}
+#endif /* SSE2_ENABLE */
+static double (*mixcarr_f)(const char *data, int dtype, double ti, int n,
+                           double freq, double phi0, short *II,
+                           short *QQ)=mixcarr_c;
+
+extern double mixcarr(const char *data, int dtype, double ti, int n,
+                      double freq, double phi0, short *II, short *QQ)
+{
+        return mixcarr_f(data,dtype,ti,n,freq,phi0,II,QQ);
+}
+
+/* fused correlator kernel -----------------------------------------------------
+* mix local carrier to data, multiply code replica taps and integrate in one
+* pass over the data
+* args   : char   *data     I   sampling data vector (n x 1 or 2n x 1)
+*          int    dtype     I   sampling data type (1:real,2:complex,4:complex int16)
+*          int    n         I   number of samples
+*          uint32_t phi     I   carrier phase of first sample (2^32=1 cycle)
+*          uint32_t ps      I   carrier phase step (2^32=1 cycle)
+*          short  *code     I   code replica (code[-smax] ... code[n+smax-1])
+*          int    *off      I   code offset of each tap (sample) (nt x 1)
+*          int    nt        I   number of taps
+*          double *II,*QQ   I/O integrated correlation I,Q (nt x 1)
+* return : none
+* notes  : carrier mixed data is kept in registers (not stored), carrier
+*          table index is the upper bits of the phase (same nco as mixcarr).
+*          remainder of the vector width is processed by corrrem
+*-----------------------------------------------------------------------------*/
+static void corrrem(const char *data, int dtype, int i, int n, uint32_t phi,
+                    uint32_t ps, const short *code, const int *off, int nt,
+                    double *II, double *QQ)
+{
+        const short *q=(const short *)data;
+        int j,k,dI,dQ;
+
+        for (phi+=(uint32_t)i*ps; i<n; i++,phi+=ps) {
+                k=phi>>CBITS;
+                if (dtype==DTYPEIQ16) {
+                        dI=mix16(ncocos[k]*q[2*i]-ncosin[k]*q[2*i+1]);
+                        dQ=mix16(ncosin[k]*q[2*i]+ncocos[k]*q[2*i+1]);
+                } else if (dtype==DTYPEIQ) {
+                        dI=ncocos[k]*data[2*i]-ncosin[k]*data[2*i+1];
+                        dQ=ncosin[k]*data[2*i]+ncocos[k]*data[2*i+1];
+                } else {
+                        dI=ncocos[k]*data[i];
+                        dQ=ncosin[k]*data[i];
+                }
+                for (j=0; j<nt; j++) {
+                        II[j]+=dI*code[i+off[j]];
+                        QQ[j]+=dQ*code[i+off[j]];
+                }
+        }
+}
+#if defined(SSE2_ENABLE)
+TARGET_SSE2 static void corrfused_sse2(const char *data, int dtype, int n,
+                                       uint32_t phi, uint32_t ps,
+                                       const short *code, const int *off,
+                                       int nt, double *II, double *QQ)
+{
+        __m128i accI[2*MAXCORRN+1],accQ[2*MAXCORRN+1];
+        __m128i xcos,xsin,ph1,ph2,step,ind,dat,re,im,cs,sn,xI,xQ,c;
         __m128i zero=_mm_setzero_si128();
-        __m128i mask4=_mm_set1_epi32(15);
-        __m128i mask8=_mm_set1_epi16(255);
+        double sum;
+        int i,j;
+
+        xcos=_mm_loadu_si128((__m128i *)ncocosq);
+        xsin=_mm_loadu_si128((__m128i *)ncosinq);
+        ph1=_mm_setr_epi32(phi,phi+ps,phi+2*ps,phi+3*ps);
+        ph2=_mm_add_epi32(ph1,_mm_set1_epi32(4*ps));
+        step=_mm_set1_epi32(8*ps);
+        for (j=0; j<nt; j++) accI[j]=accQ[j]=_mm_setzero_si128();
+
+        for (i=0; i+8<=n; i+=8) {
+                /* carrier table lookup */
+                ind=_mm_packs_epi32(_mm_srli_epi32(ph1,CBITS),
+                                    _mm_srli_epi32(ph2,CBITS));
+                NCO_LUT(cs,sn,ind,xcos,xsin);
 
-        if (!cost[0]) {
-                for (i=0; i<16; i++) {
-                        cost[i]=(char)floor((cos(DPI/16*i)/CSCALE+0.5));
-                        sint[i]=(char)floor((sin(DPI/16*i)/CSCALE+0.5));
+                /* mix local carrier */
+                if (dtype==DTYPEIQ16) { /* complex int16 */
+                        MIX_INT16C(xI,xQ,data+4*i,cs,sn);
+                } else if (dtype==DTYPEIQ) { /* complex */
+                        dat=_mm_loadu_si128((__m128i *)(data+2*i));
+                        re=_mm_srai_epi16(_mm_slli_epi16(dat,8),8);
+                        im=_mm_srai_epi16(dat,8);
+                        xI=_mm_sub_epi16(_mm_mullo_epi16(cs,re),
+                                         _mm_mullo_epi16(sn,im));
+                        xQ=_mm_add_epi16(_mm_mullo_epi16(sn,re),
+                                         _mm_mullo_epi16(cs,im));
+                } else { /* real */
+                        dat=_mm_loadl_epi64((__m128i *)(data+i));
+                        re=_mm_srai_epi16(_mm_unpacklo_epi8(zero,dat),8);
+                        xI=_mm_mullo_epi16(cs,re);
+                        xQ=_mm_mullo_epi16(sn,re);
                 }
+                /* multiply code taps and integrate */
+                for (j=0; j<nt; j++) {
+                        c=_mm_loadu_si128((__m128i *)(code+i+off[j]));
+                        accI[j]=_mm_add_epi32(accI[j],_mm_madd_epi16(xI,c));
+                        accQ[j]=_mm_add_epi32(accQ[j],_mm_madd_epi16(xQ,c));
+                }
+                ph1=_mm_add_epi32(ph1,step);
+                ph2=_mm_add_epi32(ph2,step);
+        }
+        for (j=0; j<nt; j++) {
+                SUM_INT32(sum,accI[j]); II[j]+=sum;
+                SUM_INT32(sum,accQ[j]); QQ[j]+=sum;
         }
-        phi=phi0/DPI*16-floor(phi0/DPI)*16;
-        ps=freq*16*ti;
-        xmm1=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm2=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm3=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm4=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm5=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm6=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm7=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm8=_mm_set_pd(phi+ps,phi); phi+=ps*2;
-        xmm9=_mm_set1_pd(ps*16);
-        xcos=_mm_loadu_si128((__m128i *)cost);
-        xsin=_mm_loadu_si128((__m128i *)sint);
+        corrrem(data,dtype,i,n,phi,ps,code,off,nt,II,QQ);
+}
+TARGET_AVX2 static void corrfused_avx2(const char *data, int dtype, int n,
+                                       uint32_t phi, uint32_t ps,
+                                       const short *code, const int *off,
+                                       int nt, double *II, double *QQ)
+{
+        __m256i accI[2*MAXCORRN+1],accQ[2*MAXCORRN+1];
+        __m256i xcos,xsin,ph1,ph2,step,ind,dat,re,im,cs,sn,xI,xQ,c;
+        double sum;
+        int i,j;
+
+        xcos=_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)ncocosq));
+        xsin=_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)ncosinq));
+        ph1=_mm256_setr_epi32(phi,phi+ps,phi+2*ps,phi+3*ps,
+                              phi+4*ps,phi+5*ps,phi+6*ps,phi+7*ps);
+        ph2=_mm256_add_epi32(ph1,_mm256_set1_epi32(8*ps));
+        step=_mm256_set1_epi32(16*ps);
+        for (j=0; j<nt; j++) accI[j]=accQ[j]=_mm256_setzero_si256();
+
+        for (i=0; i+16<=n; i+=16) {
+                /* carrier table lookup */
+                ind=_mm256_packus_epi32(_mm256_srli_epi32(ph1,CBITS),
+                                        _mm256_srli_epi32(ph2,CBITS));
+                if (dtype!=DTYPEIQ16) ind=_mm256_permute4x64_epi64(ind,0xD8);
+                NCO_LUT_AVX(cs,sn,ind,xcos,xsin);
 
-        if (dtype==DTYPEIQ) { /* complex */
-                for (p=data; p<data+n*2; p+=32,II+=16,QQ+=16) {
-                        LOAD_INT8C(dat1,dat2,p,zero,mask8);
-                        LOAD_INT8C(dat3,dat4,p+16,zero,mask8);
-
-                        DBLTOINT16(ind1,xmm1,xmm2,xmm3,xmm4,mask4);
-                        DBLTOINT16(ind2,xmm5,xmm6,xmm7,xmm8,mask4);
-                        ind1=_mm_packus_epi16(ind1,ind2);
-                        MIX_INT8(I1,dat1,dat3,xcos,ind1,zero);
-                        MIX_INT8(I2,dat1,dat3,xsin,ind1,zero);
-                        MIX_INT8(Q1,dat2,dat4,xsin,ind1,zero);
-                        MIX_INT8(Q2,dat2,dat4,xcos,ind1,zero);
-                        for (i=0; i<16; i++) {
-                                II[i]=I1[i]-Q1[i];
-                                QQ[i]=I2[i]+Q2[i];
-                        }
-                        xmm1=_mm_add_pd(xmm1,xmm9);
-                        xmm2=_mm_add_pd(xmm2,xmm9);
-                        xmm3=_mm_add_pd(xmm3,xmm9);
-                        xmm4=_mm_add_pd(xmm4,xmm9);
-                        xmm5=_mm_add_pd(xmm5,xmm9);
-                        xmm6=_mm_add_pd(xmm6,xmm9);
-                        xmm7=_mm_add_pd(xmm7,xmm9);
-                        xmm8=_mm_add_pd(xmm8,xmm9);
+                /* mix local carrier */
+                if (dtype==DTYPEIQ16) { /* complex int16 */
+                        MIX_INT16C_AVX(xI,xQ,data+4*i,cs,sn);
+                } else if (dtype==DTYPEIQ) { /* complex */
+                        dat=_mm256_loadu_si256((__m256i *)(data+2*i));
+                        re=_mm256_srai_epi16(_mm256_slli_epi16(dat,8),8);
+                        im=_mm256_srai_epi16(dat,8);
+                        xI=_mm256_sub_epi16(_mm256_mullo_epi16(cs,re),
+                                            _mm256_mullo_epi16(sn,im));
+                        xQ=_mm256_add_epi16(_mm256_mullo_epi16(sn,re),
+                                            _mm256_mullo_epi16(cs,im));
+                } else { /* real */
+                        re=_mm256_cvtepi8_epi16(
+                                _mm_loadu_si128((__m128i *)(data+i)));
+                        xI=_mm256_mullo_epi16(cs,re);
+                        xQ=_mm256_mullo_epi16(sn,re);
+                }
+                /* multiply code taps and integrate */
+                for (j=0; j<nt; j++) {
+                        c=_mm256_loadu_si256((__m256i *)(code+i+off[j]));
+                        accI[j]=_mm256_add_epi32(accI[j],_mm256_madd_epi16(xI,c));
+                        accQ[j]=_mm256_add_epi32(accQ[j],_mm256_madd_epi16(xQ,c));
                 }
+                ph1=_mm256_add_epi32(ph1,step);
+                ph2=_mm256_add_epi32(ph2,step);
         }
-        if (dtype==DTYPEI) { /* real */
-                for (p=data; p<data+n; p+=16,II+=16,QQ+=16) {
-                        LOAD_INT8(dat1,dat2,p,zero);
-
-                        DBLTOINT16(ind1,xmm1,xmm2,xmm3,xmm4,mask4);
-                        DBLTOINT16(ind2,xmm5,xmm6,xmm7,xmm8,mask4);
-                        ind1=_mm_packus_epi16(ind1,ind2);
-                        MIX_INT8(II,dat1,dat2,xcos,ind1,zero);
-                        MIX_INT8(QQ,dat1,dat2,xsin,ind1,zero);
-                        xmm1=_mm_add_pd(xmm1,xmm9);
-                        xmm2=_mm_add_pd(xmm2,xmm9);
-                        xmm3=_mm_add_pd(xmm3,xmm9);
-                        xmm4=_mm_add_pd(xmm4,xmm9);
-                        xmm5=_mm_add_pd(xmm5,xmm9);
-                        xmm6=_mm_add_pd(xmm6,xmm9);
-                        xmm7=_mm_add_pd(xmm7,xmm9);
-                        xmm8=_mm_add_pd(xmm8,xmm9);
+        for (j=0; j<nt; j++) {
+                SUM_INT32_AVX(sum,accI[j]); II[j]+=sum;
+                SUM_INT32_AVX(sum,accQ[j]); QQ[j]+=sum;
+        }
+        corrrem(data,dtype,i,n,phi,ps,code,off,nt,II,QQ);
+}
+TARGET_AVX512 static void corrfused_avx512(const char *data, int dtype, int n,
+                                           uint32_t phi, uint32_t ps,
+                                           const short *code, const int *off,
+                                           int nt, double *II, double *QQ)
+{
+        __m512i accI[2*MAXCORRN+1],accQ[2*MAXCORRN+1];
+        __m512i cos1,cos2,sin1,sin2,ph1,ph2,step,ind,dat,re,im,cs,sn,xI,xQ,c;
+        __m512i d1,d2,r,perm=_mm512_setr_epi64(0,2,4,6,1,3,5,7);
+        int i,j;
+
+        /* full carrier table (CDIV=64 int16) in two registers */
+        cos1=_mm512_loadu_si512((void *)ncocos);
+        cos2=_mm512_loadu_si512((void *)(ncocos+32));
+        sin1=_mm512_loadu_si512((void *)ncosin);
+        sin2=_mm512_loadu_si512((void *)(ncosin+32));
+        ph1=_mm512_add_epi32(_mm512_set1_epi32(phi),_mm512_mullo_epi32(
+                _mm512_set1_epi32(ps),_mm512_setr_epi32(0,1,2,3,4,5,6,7,8,9,
+                                                        10,11,12,13,14,15)));
+        ph2=_mm512_add_epi32(ph1,_mm512_set1_epi32(16*ps));
+        step=_mm512_set1_epi32(32*ps);
+        for (j=0; j<nt; j++) accI[j]=accQ[j]=_mm512_setzero_si512();
+
+        for (i=0; i+32<=n; i+=32) {
+                /* carrier table lookup */
+                ind=_mm512_packus_epi32(_mm512_srli_epi32(ph1,CBITS),
+                                        _mm512_srli_epi32(ph2,CBITS));
+                if (dtype!=DTYPEIQ16) ind=_mm512_permutexvar_epi64(perm,ind);
+                cs=_mm512_permutex2var_epi16(cos1,ind,cos2);
+                sn=_mm512_permutex2var_epi16(sin1,ind,sin2);
+
+                /* mix local carrier */
+                if (dtype==DTYPEIQ16) { /* complex int16 (see MIX_INT16C) */
+                        d1=_mm512_loadu_si512((void *)(data+4*i));
+                        d2=_mm512_loadu_si512((void *)(data+4*i+64));
+                        r=_mm512_set1_epi32(1<<(CSHIFT16-1));
+                        im=_mm512_sub_epi16(_mm512_setzero_si512(),sn);
+                        re=_mm512_unpacklo_epi16(cs,im);
+                        im=_mm512_unpackhi_epi16(cs,im);
+                        xI=_mm512_packs_epi32(
+                            _mm512_srai_epi32(_mm512_add_epi32(
+                                _mm512_madd_epi16(d1,re),r),CSHIFT16),
+                            _mm512_srai_epi32(_mm512_add_epi32(
+                                _mm512_madd_epi16(d2,im),r),CSHIFT16));
+                        re=_mm512_unpacklo_epi16(sn,cs);
+                        im=_mm512_unpackhi_epi16(sn,cs);
+                        xQ=_mm512_packs_epi32(
+                            _mm512_srai_epi32(_mm512_add_epi32(
+                                _mm512_madd_epi16(d1,re),r),CSHIFT16),
+                            _mm512_srai_epi32(_mm512_add_epi32(
+                                _mm512_madd_epi16(d2,im),r),CSHIFT16));
+                        xI=_mm512_permutexvar_epi64(perm,xI);
+                        xQ=_mm512_permutexvar_epi64(perm,xQ);
+                } else if (dtype==DTYPEIQ) { /* complex */
+                        dat=_mm512_loadu_si512((void *)(data+2*i));
+                        re=_mm512_srai_epi16(_mm512_slli_epi16(dat,8),8);
+                        im=_mm512_srai_epi16(dat,8);
+                        xI=_mm512_sub_epi16(_mm512_mullo_epi16(cs,re),
+                                            _mm512_mullo_epi16(sn,im));
+                        xQ=_mm512_add_epi16(_mm512_mullo_epi16(sn,re),
+                                            _mm512_mullo_epi16(cs,im));
+                } else { /* real */
+                        re=_mm512_cvtepi8_epi16(
+                                _mm256_loadu_si256((__m256i *)(data+i)));
+                        xI=_mm512_mullo_epi16(cs,re);
+                        xQ=_mm512_mullo_epi16(sn,re);
                 }
+                /* multiply code taps and integrate */
+                for (j=0; j<nt; j++) {
+                        c=_mm512_loadu_si512((void *)(code+i+off[j]));
+                        accI[j]=_mm512_add_epi32(accI[j],_mm512_madd_epi16(xI,c));
+                        accQ[j]=_mm512_add_epi32(accQ[j],_mm512_madd_epi16(xQ,c));
+                }
+                ph1=_mm512_add_epi32(ph1,step);
+                ph2=_mm512_add_epi32(ph2,step);
         }
-        prem=phi0+freq*ti*n*DPI;
-        while(prem>DPI) prem-=DPI;
-        return prem;
-#endif
+        for (j=0; j<nt; j++) {
+                II[j]+=_mm512_reduce_add_epi32(accI[j]);
+                QQ[j]+=_mm512_reduce_add_epi32(accQ[j]);
+        }
+        corrrem(data,dtype,i,n,phi,ps,code,off,nt,II,QQ);
 }
+#endif /* SSE2_ENABLE */
+static void (*corrfused)(const char *data, int dtype, int n, uint32_t phi,
+                         uint32_t ps, const short *code, const int *off,
+                         int nt, double *II, double *QQ)=NULL;
 
 /* correlator ------------------------------------------------------------------
 * multiply sampling data and carrier (I/Q), multiply code (E/P/L), and integrate
 * args   : char   *data     I   sampling data vector (n x 1 or 2n x 1)
-*          int    dtype     I   sampling data type (1:real,2:complex)
+*          int    dtype     I   sampling data type (1:real,2:complex,4:complex int16)
 *          double ti        I   sampling interval (s)
 *          int    n         I   number of samples
 *          double freq      I   carrier frequency (Hz)
@@ -1075,52 +1991,182 @@ extern double mixcarr(const char *data, int dtype, double ti, int n,
 *          short  *I,*Q     O   correlation power I,Q
 *                                 I={I_P,I_E1,I_L1,I_E2,I_L2,...,I_Em,I_Lm}
 *                                 Q={Q_P,Q_E1,Q_L1,Q_E2,Q_L2,...,Q_Em,Q_Lm}
+*          short  *dataI,*dataQ W work arrays (n+64 x 1)
+*          short  *code_e   W   work array (n+2*smax+64 x 1)
+*          sdrcbank_t *bank I/O code replica bank (NULL: no bank)
 * return : none
 * notes  : see above for data
+*          work arrays are owned by the caller (no allocation in the loop)
+*          with SIMD kernels, data is processed in blocks of CORRBLK samples:
+*          code replica of the block is taken from the bank (or resampled to
+*          code_e if code doppler drifts over bank->drift in the block) and
+*          carrier mixing, tap multiplication and integration are fused in
+*          one pass (corrfused), dataI and dataQ are not used
 *-----------------------------------------------------------------------------*/
 extern void correlator(const char *data, int dtype, double ti, int n,
                        double freq, double phi0, double crate, double coff,
                        int* s, int ns, double *II, double *QQ, double *remc,
-                       double *remp, short* codein, int coden)
+                       double *remp, short* codein, int coden,
+                       short *dataI, short *dataQ, short *code_e,
+                       sdrcbank_t *bank)
 {
-        short *dataI=NULL,*dataQ=NULL,*code_e=NULL,*code;
-        int i;
+        const short *code;
+        double r;
+        int i,off[2*MAXCORRN+1],m,nt=1+2*ns;
         int smax=s[ns-1];
+        uint32_t phi,ps;
 
         //printf("n:%d  ns:%d  s[ns-1]:%d\n",n,ns,s[ns-1]);
 
-        /* 8 is treatment of remainder in SSE2 */
-        if (!(dataI=(short *)sdrmalloc(sizeof(short)*(n+64)))||
-            !(dataQ=(short *)sdrmalloc(sizeof(short)*(n+64)))||
-            !(code_e=(short *)sdrmalloc(sizeof(short)*(n+2*smax)))) {
-                SDRPRINTF("error: correlator memory allocation\n");
+        code=code_e+smax;
+
+        if (!corrfused) { /* no SIMD kernel */
+                *remp=mixcarr(data,dtype,ti,n,freq,phi0,dataI,dataQ);
+                *remc=rescode(codein,coden,coff,smax,ti*crate,n,code_e);
+
+                dot_23(dataI,dataQ,code,code-s[0],code+s[0],n,II,QQ);
+                for (i=1; i<ns; i++) {
+                        dot_22(dataI,dataQ,code-s[i],code+s[i],n,II+1+i*2,
+                               QQ+1+i*2);
+                }
+                for (i=0; i<1+2*ns; i++) {
+                        II[i]*=MIXSCALE(dtype);
+                        QQ[i]*=MIXSCALE(dtype);
+                }
                 return;
         }
-        code=code_e+smax;
+        /* tap offsets: {P,E1,L1,E2,L2,...,Em,Lm} */
+        off[0]=0;
+        for (i=0; i<ns; i++) {
+                off[1+i*2]=-s[i];
+                off[2+i*2]= s[i];
+        }
+        for (i=0; i<nt; i++) II[i]=QQ[i]=0.0;
+
+        /* carrier nco phase and phase step */
+        phi=ncophase(phi0);
+        ps=ncostep(freq,ti);
+
+        for (i=0; i<n; i+=CORRBLK) {
+                m=n-i<CORRBLK?n-i:CORRBLK;
+
+                /* code replica of the block (bank or resampling) */
+                if ((code=codebank(bank,coff+i*ti*crate,smax,ti*crate,m))) {
+                        bank->nuse++;
+                } else {
+                        rescode(codein,coden,coff+i*ti*crate,smax,ti*crate,m,
+                                code_e);
+                        code=code_e;
+                        if (bank) bank->nfall++;
+                }
+                /* mix carrier, multiply code and integrate */
+                corrfused(data+i*dtype,dtype,m,phi+(uint32_t)i*ps,ps,
+                          code+smax,off,nt,II,QQ);
+        }
+        /* code remainder (same range as rescode) */
+        r=coff+(n+smax)*ti*crate;
+        *remc=r-floor(r/coden)*coden-smax*ti*crate;
 
-        /* mix local carrier */
-        *remp=mixcarr(data,dtype,ti,n,freq,phi0,dataI,dataQ);
+        for (i=0; i<nt; i++) {
+                II[i]*=MIXSCALE(dtype);
+                QQ[i]*=MIXSCALE(dtype);
+        }
+        *remp=ncorem(phi+(uint32_t)n*ps);
+}
+
+/* doppler shifted data spectrum -----------------------------------------------
+* data spectrum for fft based parallel correlator
+* args   : char   *data     I   sampling data vector (m x 1 or 2m x 1)
+*          int    dtype     I   sampling data type (1:real,2:complex,4:complex int16)
+*          double ti        I   sampling interval (s)
+*          int    m         I   number of samples (FFT points)
+*          double freq      I   doppler search frequency (Hz)
+*          short  *I,*Q     W   work arrays (m+64 x 1)
+*          cpx_t  *datax    O   data spectrum (m x 1)
+* return : none
+* notes  : datax=fft(data.*e^(2*pi*freq*t*i))
+*          no carrier is mixed for freq=0 (same scale as mixed data)
+*-----------------------------------------------------------------------------*/
+extern void pcorrspec(const char *data, int dtype, double ti, int m,
+                      double freq, short *II, short *QQ, cpx_t *datax)
+{
+        const short *q=(const short *)data;
+        float *p=(float *)datax,scale=1.0f/m;
+        int i;
 
-        /* resampling code */
-        *remc=rescode(codein,coden,coff,smax,ti*crate,n,code_e);
+        if (freq==0.0) {
+                /* to complex */
+                if (dtype==DTYPEIQ16) {
+                        for (i=0; i<m; i++,p+=2) {
+                                p[0]=q[2*i  ]*scale;
+                                p[1]=q[2*i+1]*scale;
+                        }
+                }
+                else if (dtype==DTYPEIQ) {
+                        for (i=0; i<m; i++,p+=2) {
+                                p[0]=data[2*i  ]*scale;
+                                p[1]=data[2*i+1]*scale;
+                        }
+                }
+                else {
+                        for (i=0; i<m; i++,p+=2) {
+                                p[0]=data[i]*scale;
+                                p[1]=0.0f;
+                        }
+                }
+        }
+        else {
+                /* mix local carrier */
+                mixcarr(data,dtype,ti,m,freq,0.0,II,QQ);
 
-        /* multiply code and integrate */
-        dot_23(dataI,dataQ,code,code-s[0],code+s[0],n,II,QQ);
-        for (i=1; i<ns; i++) {
-                dot_22(dataI,dataQ,code-s[i],code+s[i],n,II+1+i*2,QQ+1+i*2);
+                /* to complex */
+                cpxcpx(II,QQ,MIXSCALE(dtype)/m,m,datax);
         }
-        for (i=0; i<1+2*ns; i++) {
-                II[i]*=CSCALE;
-                QQ[i]*=CSCALE;
+        cpxfft(NULL,datax,m); /* fft */
+}
+
+/* doppler search bins ---------------------------------------------------------
+* split doppler search frequencies into FFT bin shifts and residual frequencies
+* args   : double *freq     I   doppler search frequencies (Hz)
+*          int    nfreq     I   number of frequencies
+*          double ti        I   sampling interval (s)
+*          int    m         I   number of FFT points
+*          int    flagfd    I   frequency domain search flag
+*                               (0: one residual frequency per search frequency)
+*          double *fres     O   residual frequencies (Hz) (nfreq x 1)
+*          int    *shift    O   FFT bin shift of each frequency (nfreq x 1)
+*          int    *resi     O   residual frequency index of each frequency
+*                               (nfreq x 1)
+* return : int                  number of residual frequencies
+* notes  : freq[i]=fres[resi[i]]+shift[i]/(m*ti)
+*          only one data FFT is needed per residual frequency, doppler search
+*          frequencies are formed by circular shift of the spectrum
+*-----------------------------------------------------------------------------*/
+extern int pcorrbins(const double *freq, int nfreq, double ti, int m,
+                     int flagfd, double *fres, int *shift, int *resi)
+{
+        double df=1.0/(m*ti),r;
+        int i,j,k,nres=0;
+
+        for (i=0; i<nfreq; i++) {
+                k=flagfd ? ROUND(freq[i]/df) : 0;
+                r=freq[i]-k*df;
+                if (fabs(r)<1E-6) r=0.0;
+
+                for (j=0; j<nres; j++) {
+                        if (fabs(fres[j]-r)<1E-6) break;
+                }
+                if (j==nres) fres[nres++]=r;
+                shift[i]=k;
+                resi[i]=j;
         }
-        sdrfree(dataI); sdrfree(dataQ); sdrfree(code_e);
-        dataI=dataQ=code_e=NULL;
+        return nres;
 }
 
 /* parallel correlator ---------------------------------------------------------
 * fft based parallel correlator
 * args   : char   *data     I   sampling data vector (n x 1 or 2n x 1)
-*          int    dtype     I   sampling data type (1:real,2:complex)
+*          int    dtype     I   sampling data type (1:real,2:complex,4:complex int16)
 *          double ti        I   sampling interval (s)
 *          int    n         I   number of samples
 *          double *freq     I   doppler search frequencies (Hz)
@@ -1128,23 +2174,29 @@ extern void correlator(const char *data, int dtype, double ti, int n,
 *          double crate     I   code chip rate (chip/s)
 *          int    m         I   number of resampling data
 *          cpx_t  codex     I   frequency domain code
-*          double *P        O   normalized correlation power vector
+*          int    flagfd    I   frequency domain doppler search flag
+*                               (see pcorrbins)
+*          float  *P        O   normalized correlation power vector
 * return : none
 * notes  : P=abs(ifft(conj(fft(code)).*fft(data.*e^(2*pi*freq*t*i)))).^2
 *-----------------------------------------------------------------------------*/
 extern void pcorrelator(const char *data, int dtype, double ti, int n,
                         double *freq, int nfreq, double crate, int m,
-                        cpx_t* codex, double *P)
+                        cpx_t* codex, int flagfd, float *P)
 {
-        int i;
-        cpx_t *datax;
+        int i,j,nres,*shift,*resi;
+        double *fres;
+        cpx_t *datax,*work;
         short *dataI,*dataQ;
         char *dataR;
 
         if (!(dataR=(char  *)sdrmalloc(sizeof(char )*m*dtype))||
             !(dataI=(short *)sdrmalloc(sizeof(short)*(m+64)))||
             !(dataQ=(short *)sdrmalloc(sizeof(short)*(m+64)))||
-            !(datax=cpxmalloc(m))) {
+            !(datax=cpxmalloc(m))||!(work=cpxmalloc(m))||
+            !(fres=(double *)malloc(sizeof(double)*nfreq))||
+            !(shift=(int *)malloc(sizeof(int)*nfreq))||
+            !(resi=(int *)malloc(sizeof(int)*nfreq))) {
                 SDRPRINTF("error: pcorrelator memory allocation\n");
                 return;
         }
@@ -1153,20 +2205,127 @@ extern void pcorrelator(const char *data, int dtype, double ti, int n,
         memset(dataR,0,m*dtype); /* zero paddinng */
         memcpy(dataR,data,2*n*dtype); /* for zero padding FFT */
 
-        for (i=0; i<nfreq; i++) {
-                /* mix local carrier */
-                mixcarr(dataR,dtype,ti,m,freq[i],0.0,dataI,dataQ);
+        nres=pcorrbins(freq,nfreq,ti,m,flagfd,fres,shift,resi);
 
-                /* to complex */
-                cpxcpx(dataI,dataQ,CSCALE/m,m,datax);
+        for (i=0; i<nres; i++) {
+                /* doppler shifted data spectrum */
+                pcorrspec(dataR,dtype,ti,m,fres[i],dataI,dataQ,datax);
 
                 /* convolution */
-                cpxconv(NULL,NULL,datax,codex,m,n,1,&P[i*n]);
+                for (j=0; j<nfreq; j++) {
+                        if (resi[j]!=i) continue;
+                        cpxconvx(NULL,datax,shift[j],codex,m,n,1,work,&P[j*n]);
+                }
         }
         sdrfree(dataR);
         sdrfree(dataI);
         sdrfree(dataQ);
         cpxfree(datax);
+        cpxfree(work);
+        free(fres);
+        free(shift);
+        free(resi);
+}
+
+/* SIMD kernel name ------------------------------------------------------------
+* args   : int    simd      I   SIMD kernels (SIMD_???)
+* return : char*                name of SIMD kernels
+*-----------------------------------------------------------------------------*/
+extern const char *simdname(int simd)
+{
+        switch (simd) {
+                case SIMD_AUTO:   return "AUTO";
+                case SIMD_SSE2:   return "SSE2";
+                case SIMD_AVX2:   return "AVX2";
+                case SIMD_AVX512: return "AVX512";
+                default:          return "NONE";
+        }
+}
+
+/* SIMD kernel code ------------------------------------------------------------
+* args   : char   *str      I   name of SIMD kernels (AUTO,NONE,SSE2,AVX2,
+*                               AVX512, case insensitive)
+* return : int                  SIMD kernels (SIMD_???, SIMD_AUTO if unknown)
+*-----------------------------------------------------------------------------*/
+extern int simdcode(const char *str)
+{
+        char buff[16];
+        int i;
+
+        for (i=0; str[i]&&i<(int)sizeof(buff)-1; i++) {
+                buff[i]=(char)toupper((unsigned char)str[i]);
+        }
+        buff[i]='\0';
+        if (!strcmp(buff,"NONE")||!strcmp(buff,"C")) return SIMD_NONE;
+        if (!strcmp(buff,"SSE2")||!strcmp(buff,"SSE")) return SIMD_SSE2;
+        if (!strcmp(buff,"AVX2")||!strcmp(buff,"AVX")) return SIMD_AVX2;
+        if (!strcmp(buff,"AVX512"))                    return SIMD_AVX512;
+        return SIMD_AUTO;
+}
+
+/* SIMD kernels supported by cpu ---------------------------------------------*/
+static int simdcpu(void)
+{
+#if defined(SSE2_ENABLE)
+        __builtin_cpu_init(); /* cpuid and os (xgetbv) support */
+
+        if (__builtin_cpu_supports("avx512f")&&
+            __builtin_cpu_supports("avx512bw")) return SIMD_AVX512;
+        if (__builtin_cpu_supports("avx2")&&
+            __builtin_cpu_supports("fma"))      return SIMD_AVX2;
+        if (__builtin_cpu_supports("ssse3"))    return SIMD_SSE2;
+#endif
+        return SIMD_NONE;
+}
+
+/* initialize SIMD kernels -----------------------------------------------------
+* probe cpu and bind SIMD kernels (mixcarr, rescode, dot_2?, sumv?, cpxconv
+* and fused correlator) to the best implementation
+* args   : int    simd      I   SIMD kernels (SIMD_AUTO: best supported)
+* return : int                  selected SIMD kernels (SIMD_???)
+* notes  : environment variable SIMDENV overrides simd
+*          call once at start before any sdr thread is created
+*-----------------------------------------------------------------------------*/
+extern int simdinit(int simd)
+{
+        const char *env;
+        int cpu=simdcpu(),sel;
+
+        if ((env=getenv(SIMDENV))&&*env) simd=simdcode(env);
+
+        sel=simd==SIMD_AUTO ? cpu : simd;
+        if (sel>cpu) {
+                SDRPRINTF("warning: %s kernels not supported by cpu\n",
+                          simdname(sel));
+                sel=cpu;
+        }
+        ncoinit();
+        cpxmulconj=cpxmulconj_c; cpxpowacc=cpxpowacc_c;
+        dot_21_f=dot_21_c; dot_22_f=dot_22_c; dot_23_f=dot_23_c;
+        sumvf_f=sumvf_c; sumvd_f=sumvd_c;
+        rescode_f=rescode_c; mixcarr_f=mixcarr_c;
+        corrfused=NULL;
+#if defined(SSE2_ENABLE)
+        if (sel>=SIMD_SSE2) {
+                cpxmulconj=cpxmulconj_sse2; cpxpowacc=cpxpowacc_sse2;
+                dot_21_f=dot_21_sse2; dot_22_f=dot_22_sse2; dot_23_f=dot_23_sse2;
+                rescode_f=rescode_sse2; mixcarr_f=mixcarr_sse2;
+                corrfused=corrfused_sse2;
+        }
+        if (sel>=SIMD_AVX2) {
+                cpxmulconj=cpxmulconj_avx2; cpxpowacc=cpxpowacc_avx2;
+                dot_21_f=dot_21_avx2; dot_22_f=dot_22_avx2; dot_23_f=dot_23_avx2;
+                sumvf_f=sumvf_avx; sumvd_f=sumvd_avx; mixcarr_f=mixcarr_avx2;
+                corrfused=corrfused_avx2;
+        }
+        if (sel>=SIMD_AVX512) {
+                cpxmulconj=cpxmulconj_avx512; cpxpowacc=cpxpowacc_avx512;
+                corrfused=corrfused_avx512;
+        }
+#endif
+        SDRPRINTF("SIMD kernels: %s (cpu: %s, request: %s%s)\n",simdname(sel),
+                  simdname(cpu),simdname(simd),env&&*env ? " by " SIMDENV : "");
+        return sel;
 }
 
 // Function to calculate the number of leap seconds since GPS epoch
@@ -63,6 +63,9 @@ extern void updateNavStatusWin(WINDOW *win1, int counter)
   double gps_tow;
   char bufferNav[256];
   char str1[10];
+  double lagmax = 0.0;
+  unsigned long noverrun = 0;
+  int lagprn = 0;
 
   // Load in data to display
   mlock(hobsvecmtx);
@@ -71,6 +74,11 @@ extern void updateNavStatusWin(WINDOW *win1, int counter)
     flagacq[i] = sdrch[i].flagacq;
     flagsync[i] = sdrch[i].nav.flagsync;
     flagdec[i] = sdrch[i].nav.flagdec;
+    if (sdrch[i].flagacq && sdrch[i].task.lagms > lagmax) {
+      lagmax = sdrch[i].task.lagms;
+      lagprn = sdrch[i].prn;
+    }
+    noverrun += sdrch[i].task.noverrun;
   }
   nsat = sdrstat.nsatValid;
   lat = sdrstat.lat;
@@ -110,6 +118,11 @@ extern void updateNavStatusWin(WINDOW *win1, int counter)
   mvwprintw(win1, 1, 2, "Elapsed Time:   %.3f", sdrstat.elapsedTime);
   mvwprintw(win1, 2, 2, "%s", bufferNav);
 
+  // Update channel lag behind the front end (max over tracked channels)
+  mvwprintw(win1, 3, 2, "Channel Lag:    %.0f ms (G%02d)  Overruns: %lu"
+    "  Shed Level: %d  CPU: %.0f%%", lagmax, lagprn, noverrun,
+    sdrshed.level, sdrshed.cpu);
+
   // Update filter mode
   if (sdrini.ekfFilterOn) {
     mvwprintw(win1, 1, 70, "Filter Mode: Kalman (EKF)");
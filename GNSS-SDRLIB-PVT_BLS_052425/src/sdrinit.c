@@ -205,6 +205,61 @@ extern int readinifile(sdrini_t *ini)
     //printf("FONTFILE: %s\n", ini->fontfile);
     ini->ekfFilterOn=readiniint(inifile,"PVT","EKFFILTER");
 
+    // Acquisition setting
+    ini->acqbatch=readiniint(inifile,"ACQ","BATCH");
+    ini->acqnthr =readiniint(inifile,"ACQ","THREADS");
+    if (ini->acqnthr<=0) ini->acqnthr=ini->acqbatch?1:0;
+    if (ini->acqnthr>MAXACQTHREAD) ini->acqnthr=MAXACQTHREAD;
+    ini->acqfd   =readiniint(inifile,"ACQ","FDSEARCH");
+    ini->acq2step=readiniint(inifile,"ACQ","TWOSTAGE");
+    ini->acqaid  =readiniint(inifile,"ACQ","AIDED");
+    ini->acqvis  =readiniint(inifile,"ACQ","VISIBILITY");
+    ini->acqcstep=readinidouble(inifile,"ACQ","COARSESTEP");
+    ini->acqcintg=readiniint(inifile,"ACQ","COARSEINTG");
+    ini->acqfstep=readinidouble(inifile,"ACQ","FINESTEP");
+    if (ini->acqcstep<=0.0) ini->acqcstep=ACQCSTEP;
+    if (ini->acqcintg<=0)   ini->acqcintg=ACQCINTG;
+    if (ini->acqfstep<=0.0) ini->acqfstep=ACQFSTEP;
+
+    // FFT setting
+    readinistr(inifile,"FFT","PLANNER",str);
+    if (strcmp(str,"PATIENT")==0)      ini->fftplanner=2;
+    else if (strcmp(str,"MEASURE")==0) ini->fftplanner=1;
+    else                               ini->fftplanner=0;
+    readinistr(inifile,"FFT","WISDOM",ini->fftwisdom);
+    if (ini->fftplanner&&!ini->fftwisdom[0]) {
+        strcpy(ini->fftwisdom,FFTWISDOM);
+    }
+
+    // Tracking code replica bank (0: resample code every epoch)
+    ini->trkcbank  =readiniint(inifile,"TRACK","CODEBANK");
+    ini->trkcbdrift=readinidouble(inifile,"TRACK","CODEDRIFT");
+    if (ini->trkcbank<0) ini->trkcbank=0;
+    if (ini->trkcbank>MAXCBPHASE) ini->trkcbank=MAXCBPHASE;
+    if (ini->trkcbdrift<=0.0) ini->trkcbdrift=TRKCBDRIFT;
+
+    // SIMD setting (AUTO if not set)
+    readinistr(inifile,"CPU","SIMD",str);
+    ini->simd=simdcode(str);
+
+    // Channel workers (0: one per real-time cpu, see startworkers)
+    ini->nworker=readiniint(inifile,"CPU","WORKERS");
+
+    // Load shedding (see shedthread)
+    ini->shed     =readiniint(inifile,"SHED","ENABLE");
+    ini->shedlag  =readinidouble(inifile,"SHED","LAGMS");
+    ini->shedcpu  =readinidouble(inifile,"SHED","CPU");
+    ini->shedhold =readinidouble(inifile,"SHED","HOLD");
+    ini->shedminch=readiniint(inifile,"SHED","MINCH");
+    ini->shedoutms=readiniint(inifile,"SHED","OUTMS");
+    if (ini->shedlag<=0.0)  ini->shedlag=SHEDLAG;
+    if (ini->shedcpu<=0.0)  ini->shedcpu=SHEDCPU;
+    if (ini->shedhold<=0.0) ini->shedhold=SHEDHOLD;
+    if (ini->shedminch<=0)  ini->shedminch=SHEDMINCH;
+    if (ini->shedoutms<ini->outms) {
+        ini->shedoutms=ini->outms>SHEDOUTMS?ini->outms:SHEDOUTMS;
+    }
+
     // SDR channel setting
     for (i=0;i<sdrini.nch;i++) {
         if (sdrini.ctype[i]==CTYPE_L1CA) {
@@ -241,6 +296,20 @@ extern int chk_initvalue(sdrini_t *ini)
         }
     }
 
+    // checking two-stage acquisition steps   
+    if (ini->acq2step&&(ini->acqcstep>ACQHBAND||ini->acqfstep>ini->acqcstep)) {
+        SDRPRINTF("error: wrong acq. steps coarse: %.0f fine: %.0f\n",
+            ini->acqcstep,ini->acqfstep);
+        return -1;
+    }
+
+    // checking correlation points   
+    if (ini->trkcorrn<1||ini->trkcorrn>MAXCORRN) {
+        SDRPRINTF("error: wrong corr. points corrn: %d (max %d)\n",
+            ini->trkcorrn,MAXCORRN);
+        return -1;
+    }
+
     // checking filepath   
     if (ini->fend==FEND_FILE   ||
         ini->fend==FEND_FRTLSDR||ini->fend==FEND_FBLADERF) {
@@ -269,13 +338,17 @@ extern int chk_initvalue(sdrini_t *ini)
 extern void openhandles(void)
 {
     // mutexes   
-    initmlock(hbuffmtx);
     initmlock(hreadmtx);
     initmlock(hfftmtx);
     initmlock(hobsmtx);
     initmlock(hresetmtx);
     initmlock(hobsvecmtx);
     initmlock(hmsgmtx);
+    initmlock(hacqmtx);
+
+    // events
+    initevent(hreadevent);
+    initevent(hobsevent);
 }
 
 // close mutex and event -------------------------------------------------------
@@ -286,13 +359,17 @@ extern void openhandles(void)
 extern void closehandles(void)
 {
     // mutexes   
-    delmlock(hbuffmtx);
     delmlock(hreadmtx);
     delmlock(hfftmtx);
     delmlock(hobsmtx);
     delmlock(hresetmtx);
     delmlock(hobsvecmtx);
     delmlock(hmsgmtx);
+    delmlock(hacqmtx);
+
+    // events
+    delevent(hreadevent);
+    delevent(hobsevent);
 }
 
 // initialize acquisition struct -----------------------------------------------
@@ -310,6 +387,19 @@ extern void initacqstruct(int sys, int ctype, int prn, sdracq_t *acq)
     acq->hband=ACQHBAND;
     acq->step=ACQSTEP;
     acq->nfreq=2*(ACQHBAND/ACQSTEP)+1;
+
+    // two-stage search: short coarse search over the full band, then fine
+    // search within +/-(coarse step) of the candidates (see sdracqfine)
+    acq->fintg=acq->intg;
+    acq->fstep=acq->step;
+    acq->nffreq=0;
+    if (sdrini.acq2step) {
+        acq->intg=sdrini.acqcintg;
+        acq->step=sdrini.acqcstep;
+        acq->nfreq=2*(int)(ACQHBAND/acq->step)+1;
+        acq->fstep=sdrini.acqfstep;
+        acq->nffreq=2*(int)(acq->step/acq->fstep)+1;
+    }
 }
 
 // initialize tracking parameter struct ----------------------------------------
@@ -474,7 +564,7 @@ extern int initnavstruct(int sys, int ctype, int prn, sdrnav_t *nav)
 //         int    sys       I   system type (SYS_***)
 //         int    prn       I   PRN number
 //         int    ctype     I   code type (CTYPE_***)
-//         int    dtype     I   data type (DTYPEI or DTYPEIQ)
+//         int    dtype     I   data type (DTYPEI, DTYPEIQ or DTYPEIQ16)
 //         int    ftype     I   front end type (FTYPE1 or FTYPE2)
 //         int    f_gain	I	rx gain
 //         int    f_bias	I	rx bias-tee
@@ -530,7 +620,8 @@ extern int initsdrch(int chno, int sys, int prn, int ctype, int dtype,
     sdr->acq.nfft=2*sdr->nsamp;//calcfftnum(2*sdr->nsamp,0);
 
     // memory allocation   
-    if (!(sdr->acq.freq=(double*)malloc(sizeof(double)*sdr->acq.nfreq))) {
+    if (!(sdr->acq.freq=(double*)malloc(sizeof(double)*sdr->acq.nfreq))||
+        !(sdr->acq.ffreq=(double*)malloc(sizeof(double)*(sdr->acq.nffreq+1)))) {
         SDRPRINTF("error: initsdrch memory alocation\n"); return -1;
     }
 
@@ -542,6 +633,25 @@ extern int initsdrch(int chno, int sys, int prn, int ctype, int dtype,
     // tracking struct   
     if (inittrkstruct(sdr->sat,ctype,sdr->ctime,&sdr->trk)<0) return -1;
 
+    // tracking scratch buffers (sized for the max code doppler stretch,
+    // reused every epoch)
+    sdr->buf.nmax=(int)(sdr->nsamp*(1.0+TRKSTRETCH))+sdr->nsampchip+1;
+    sdr->buf.smax=sdr->trk.corrp[sdr->trk.corrn-1];
+    if (!(sdr->buf.data=(char*)sdrmalloc(sizeof(char)*(sdr->buf.nmax+100)*
+                                         dtype))||
+        !(sdr->buf.dataI=(short*)sdrmalloc(sizeof(short)*(sdr->buf.nmax+64)))||
+        !(sdr->buf.dataQ=(short*)sdrmalloc(sizeof(short)*(sdr->buf.nmax+64)))||
+        !(sdr->buf.code=(short*)sdrmalloc(sizeof(short)*
+                              (sdr->buf.nmax+2*sdr->buf.smax+64)))) {
+        SDRPRINTF("error: initsdrch memory alocation\n"); return -1;
+    }
+    // code replica bank at nominal code rate (tracking picks the nearest
+    // fractional phase instead of resampling the code every epoch)
+    if (gencodebank(sdr->code,sdr->clen,sdr->ci,sdr->buf.smax,
+                    sdrini.trkcbank,sdrini.trkcbdrift,&sdr->cbank)<0) {
+        SDRPRINTF("error: initsdrch memory alocation\n"); return -1;
+    }
+
     // navigation struct   
     if (initnavstruct(sys,ctype,prn,&sdr->nav)<0) {
         return -1;
@@ -583,6 +693,12 @@ extern void freesdrch(sdrch_t *sdr)
     free(sdr->trk.oldsumQ);
     free(sdr->trk.corrp);
     free(sdr->acq.freq);
+    free(sdr->acq.ffreq);
+    sdrfree(sdr->buf.data);
+    sdrfree(sdr->buf.dataI);
+    sdrfree(sdr->buf.dataQ);
+    sdrfree(sdr->buf.code);
+    freecodebank(&sdr->cbank);
 
     if (sdr->nav.fec!=NULL)
         delete_viterbi27_port(sdr->nav.fec);
@@ -12,21 +12,36 @@ thread_t hsyncthread;
 thread_t hkeythread;
 thread_t hdatathread;
 thread_t hguithread;
+thread_t hacqthread[MAXACQTHREAD];
+thread_t hshedthread;
 
-mlock_t hbuffmtx;
 mlock_t hreadmtx;
 mlock_t hfftmtx;
 mlock_t hobsmtx;
 mlock_t hresetmtx;
 mlock_t hobsvecmtx;
 mlock_t hmsgmtx;
+mlock_t hacqmtx;
+event_t hreadevent;
+event_t hobsevent;
 
 // SDR structs
 sdrini_t sdrini={0};
 sdrstat_t sdrstat={0};
-sdrch_t sdrch[MAXSAT]={{0}};
+sdrch_t sdrch[MAXSAT]={{{0}}};
 sdrekf_t sdrekf={0};
 sdrgui_t sdrgui={0};
+sdrworker_t sdrworker[MAXWORKER];
+sdrshed_t sdrshed={0};
+
+// Ring overrun test (gnss-sdrlib-pvt -overrun, see overrunstall)
+static struct {
+  int on;          // test enabled
+  int prn;         // PRN of the stalled channel (0: not stalled yet)
+  int pass;        // test result
+} ovrtest={0};
+static int overrunstall(sdrch_t *sdr);
+static int overruncheck(void);
 
 // Keyboard thread ------------------------------------------------------------
 // keyboard thread for program termination
@@ -65,6 +80,18 @@ int main(int argc, char **argv)
     return -1;
   }
 
+  // Select SIMD kernels (ini [CPU] SIMD, overridden by GNSS_SDR_SIMD)
+  simdinit(sdrini.simd);
+
+  // Acquisition benchmark (gnss-sdrlib-pvt -bench [max threads])
+  if (argc>1&&!strcmp(argv[1],"-bench")) {
+    return acqbench(argc>2 ? atoi(argv[2]) :
+                    (int)sysconf(_SC_NPROCESSORS_ONLN));
+  }
+
+  // Ring overrun test on a file front end (gnss-sdrlib-pvt -overrun)
+  if (argc>1&&!strcmp(argv[1],"-overrun")) ovrtest.on=1;
+
   // Declare CPU affinity variables
   int num_cpus;
   cpu_set_t cpu_set;
@@ -74,21 +101,76 @@ int main(int argc, char **argv)
 
   // We will leave the last four CPUs for OS tasks, then enable the rest for
   // real-time use by main. Select CPUs to use with CPU_SET.
+  CPU_ZERO(&cpu_set);
   for (int n=0;n<(num_cpus-4);n++) {
     CPU_SET(n, &cpu_set);
   }
 
-  // Schedule the cores for use by main using sched_setaffinity
-  if (sched_setaffinity(getpid(), sizeof(cpu_set_t), &cpu_set) == -1) {
+  // Schedule the cores for use by main using sched_setaffinity (all CPUs
+  // are kept with four or less)
+  if (CPU_COUNT(&cpu_set)>0 &&
+      sched_setaffinity(getpid(), sizeof(cpu_set_t), &cpu_set) == -1) {
     perror("error: sched_setaffinity\n");
   }
 
   // Start SDR and threads
   startsdr();
 
+  if (ovrtest.on) return ovrtest.pass?0:-1;
   return 0;
 }
 
+// Start channel workers ------------------------------------------------------
+// create channel worker threads and deal out the channel tasks
+// args   : none
+// return : none
+// note : sdrini.nworker (0: one per cpu of the process affinity, i.e. the
+//        real-time cpus set in main) workers are pinned to those cpus
+//-----------------------------------------------------------------------------
+static void startworkers(void)
+{
+  cpu_set_t cpus;
+  int i,j,n=0,ncpu,cpu[CPU_SETSIZE],ret;
+  unsigned long tick=tickgetus()/1000;
+
+  // Real-time cpus
+  CPU_ZERO(&cpus);
+  if (sched_getaffinity(0,sizeof(cpu_set_t),&cpus)==-1) CPU_ZERO(&cpus);
+  for (i=0,ncpu=0;i<CPU_SETSIZE;i++) {
+    if (CPU_ISSET(i,&cpus)) cpu[ncpu++]=i;
+  }
+  if (sdrini.nworker<=0) sdrini.nworker=ncpu;
+  if (sdrini.nworker>MAXWORKER) sdrini.nworker=MAXWORKER;
+  if (sdrini.nworker>sdrini.nch) sdrini.nworker=sdrini.nch;
+  if (sdrini.nworker<1) sdrini.nworker=1;
+
+  for (i=0;i<sdrini.nworker;i++) {
+    memset(&sdrworker[i],0,sizeof(sdrworker_t));
+    sdrworker[i].no=i;
+    sdrworker[i].cpu=ncpu>0?cpu[i%ncpu]:-1;
+    initmlock(sdrworker[i].hmtx);
+  }
+  // GPS/QZS/GLO/GAL/CMP L1 channel tasks in turn
+  for (i=0;i<sdrini.nch;i++) {
+    if (sdrch[i].ctype!=CTYPE_L1CA&&sdrch[i].ctype!=CTYPE_L1SBAS) continue;
+
+    // Slightly delay the start of each channel independently (not needed
+    // with acquisition workers, which schedule all channel requests)
+    if (!sdrini.acqnthr) sdrch[i].task.tnext=tick+sdrch[i].no*500;
+
+    j=n++%sdrini.nworker;
+    sdrworker[j].ch[sdrworker[j].n++]=i;
+  }
+  for (i=0;i<sdrini.nworker;i++) {
+    ret=pthread_create(&sdrworker[i].hthr,NULL,sdrworkthread,&sdrworker[i]);
+    if (ret) {
+      printf(BRED "Create for channel worker failed: %s\n" reset,
+             strerror(ret));
+    }
+  }
+  SDRPRINTF("Channel workers: %d for %d channels\n",sdrini.nworker,n);
+}
+
 // sdr start ------------------------------------------------------------------
 // start sdr function
 // args   : void   *arg      I   not used
@@ -196,6 +278,9 @@ extern void startsdr(void)
   // mutexes and events
   openhandles();
 
+  // PVT output interval (reduced by load shedding)
+  sdrshed.outms=sdrini.outms;
+
   // Create threads ---------------------------------------------------------
   // Keyboard thread
   //ret = pthread_create(&hkeythread,&attr2,keythread,NULL);
@@ -213,18 +298,26 @@ extern void startsdr(void)
            strerror(ret));
   }
 
-  // SDR channel threads
-  for (i=0;i<sdrini.nch;i++) {
-    // GPS/QZS/GLO/GAL/CMP L1
-    if (sdrch[i].ctype==CTYPE_L1CA  || sdrch[i].ctype==CTYPE_L1SBAS){
-      //ret=pthread_create(&sdrch[i].hsdr,&attr1,sdrthread,&sdrch[i]);
-      ret=pthread_create(&sdrch[i].hsdr,NULL,sdrthread,&sdrch[i]);
-      if (ret) {
-        printf(BRED "Create for sdr thread failed: %s\n" reset,
-               strerror(ret));
-      } // if
-    } // if
-  } // for (sdrch threads)
+  // SDR channel workers (channel tasks dealt out in turn)
+  startworkers();
+
+  // Load shedding supervisor
+  if (sdrini.shed) {
+    ret=pthread_create(&hshedthread,NULL,shedthread,NULL);
+    if (ret) {
+      printf(BRED "Create for shedding thread failed: %s\n" reset,
+             strerror(ret));
+    }
+  }
+
+  // Acquisition worker threads
+  for (i=0;i<sdrini.acqnthr;i++) {
+    ret=pthread_create(&hacqthread[i],NULL,acqthread,NULL);
+    if (ret) {
+      printf(BRED "Create for acquisition thread failed: %s\n" reset,
+             strerror(ret));
+    }
+  }
 
   // Data grabber thread
   //ret=pthread_create(&hdatathread,&attr1,datathread,NULL);
@@ -326,9 +419,19 @@ extern void startsdr(void)
 
   // Wait (pthreads join) threads
   waitthread(hsyncthread);
-  for (i=0;i<sdrini.nch;i++) {
-    waitthread(sdrch[i].hsdr);
+  if (sdrini.shed) {
+    waitthread(hshedthread);
+    SDRPRINTF("Load shedding: max level %d\n",sdrshed.maxlevel);
+  }
+  for (i=0;i<sdrini.nworker;i++) {
+    waitthread(sdrworker[i].hthr);
+    SDRPRINTF("Channel worker %d (cpu %d) steps=%lu stolen=%lu\n",i,
+              sdrworker[i].cpu,sdrworker[i].nstep,sdrworker[i].nsteal);
+    delmlock(sdrworker[i].hmtx);
   }
+  for (i=0;i<sdrini.nch;i++) sdrchfinish(&sdrch[i]);
+  for (i=0;i<sdrini.acqnthr;i++) waitthread(hacqthread[i]);
+  if (ovrtest.on) ovrtest.pass=overruncheck();
   waitthread(hdatathread);
 
   // SDR termination
@@ -353,6 +456,9 @@ extern void quitsdr(sdrini_t *ini, int stop)
     rcvquit(ini);
     if (stop==2) return;
 
+    // FFT plans (save wisdom for next start)
+    fftquit();
+
     // Free memory
     for (i=0;i<ini->nch;i++) freesdrch(&sdrch[i]);
     if (stop==3) return;
@@ -362,192 +468,523 @@ extern void quitsdr(sdrini_t *ini, int stop)
     if (stop==4) return;
 }
 
-// sdr channel thread ---------------------------------------------------------
-// sdr channel thread for signal acquisition and tracking
-// args   : void   *arg      I   sdr channel struct
+// defer channel step ---------------------------------------------------------
+// channel is not stepped again before ms milliseconds (replaces sleeping in
+// the channel, which would block the worker running it)
+// args   : sdrch_t *sdr     I/O sdr channel struct
+//          int    ms        I   delay (ms)
 // return : none
-// note : This thread handles the acquisition and tracking of one of the signals.
-//        The thread is created at startsdr function.
 //-----------------------------------------------------------------------------
-extern void *sdrthread(void *arg)
+extern void sdrdefer(sdrch_t *sdr, int ms)
 {
-  sdrch_t *sdr=(sdrch_t*)arg;
-  uint64_t buffloc=0,bufflocnow=0,cnt=0,loopcnt=0;
-  double *acqpower=NULL;
-  double snr, el;
-  int ret = 0;
+  sdr->task.tnext=tickgetus()/1000+ms;
+}
+
+// Ring overrun test stall ----------------------------------------------------
+// defer the first channel that decoded navigation data once, longer than the
+// sample ring lasts, so that its samples are overwritten by the file grabber
+// (the worker goes on with the other channels)
+// args   : sdrch_t *sdr     I/O sdr channel struct
+// return : int                  1: channel deferred, 0: not
+//-----------------------------------------------------------------------------
+static int overrunstall(sdrch_t *sdr)
+{
+  int prn=0, ms;
   char bufferSDR[MSG_LENGTH];
 
-  // Establish timer parameters
-  time_t current_time;//start_time_acq,start_time_nav,start_time_snr,
-  time_t start_acq_timer; // Starts when flagacq equals 1
-  start_acq_timer = time(NULL); // declare it here, but really assigned by acq
-  double elapsed_acq_time = 0;
+  if (!sdr->nav.flagdec||sdr->task.elapsed<OVRTESTWAIT) return 0;
+  if (!__atomic_compare_exchange_n(&ovrtest.prn,&prn,sdr->prn,0,
+      __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST)) return 0;
+
+  ms=(int)(1000.0*MEMBUFFLEN*sdrstat.fendbuffsize/sdr->f_sf)+1000;
+  snprintf(bufferSDR, sizeof(bufferSDR),
+    "%.3f  G%02d overrun test: stalling %d ms\n",
+    sdrstat.elapsedTime, sdr->prn, ms);
+  add_message(bufferSDR);
+  sdrdefer(sdr,ms);
+  return 1;
+}
 
-  // Slightly delay the start of each thread independently
-  sleepms(sdr->no*500);
+// Ring overrun test check ----------------------------------------------------
+// the stalled channel must have seen the overrun and be tracking again, by
+// resync (or by aided reacquisition if built with -DTEST_OVRAIDED, see
+// trkresync) without a blind search
+// args   : none
+// return : int                  1: pass, 0: fail
+//-----------------------------------------------------------------------------
+static int overruncheck(void)
+{
+  sdrch_t *sdr;
+  int pass, aided = 0;
 
-  //-------------------------------------------------------------------------
-  // While loop for sdrch thread
-  //-------------------------------------------------------------------------
-  while (!sdrstat.stopflag) {
+#if defined(TEST_OVRAIDED)
+  aided = 1;
+#endif
 
-    // SDR Channel Reset Checks -------------------------------------------
-    // Calculate elapsed time since flagacq was set.
-    current_time = time(NULL);
-    if (sdr->flagacq) {
-      elapsed_acq_time = current_time - start_acq_timer;
-    }
+  if (!ovrtest.prn) {
+    SDRPRINTF("overrun test: FAIL (no channel decoded navigation data)\n");
+    return 0;
+  }
+  sdr=&sdrch[ovrtest.prn-1];
+  pass=sdr->task.noverrun>0&&sdr->flagacq&&sdr->nav.flagdec&&
+       (aided?sdr->task.naided>0:sdr->task.nresync>0);
+
+  SDRPRINTF("overrun test (%s): G%02d overruns=%lu resyncs=%lu aided=%lu "
+            "tracking=%d: %s\n",aided?"aided":"resync",sdr->prn,
+            sdr->task.noverrun,sdr->task.nresync,sdr->task.naided,
+            sdr->flagacq,pass?"PASS":"FAIL");
+  return pass;
+}
 
-    // Every 30s check SNR to make sure it is not too low
-    if (elapsed_acq_time>60) {
-      mlock(hobsmtx);
-      snr = sdr->trk.S[0];
-      unmlock(hobsmtx);
+// sdr channel step -----------------------------------------------------------
+// advance sdr channel by one step: one acquisition attempt or tracking of
+// one code period
+// args   : sdrch_t *sdr     I/O sdr channel struct
+// return : int                  SDRSTEP_RUN: acquisition or tracking run,
+//                               SDRSTEP_IDLE: nothing to do (deferred or
+//                               samples of next code not received yet)
+// note : This handles the acquisition and tracking of one of the signals.
+//        Steps of all channels are run by the channel workers (see
+//        sdrworkthread), state between steps is kept in sdr->task.
+//-----------------------------------------------------------------------------
+extern int sdrchstep(sdrch_t *sdr)
+{
+  sdrtask_t *task=&sdr->task;
+  double snr, el;
+  uint64_t buffloc;
+  int ret = 0, skipacq = 0, shed, aided = 0;
+  char bufferSDR[MSG_LENGTH];
 
-      // If SNR is low, set resetflag for this channel
-      if (snr<SNR_RESET_THRES) {
+  // Deferred (acquisition interval, reset delay)
+  if (task->tnext&&tickgetus()/1000<task->tnext) return SDRSTEP_IDLE;
+  task->tnext=0;
+  task->need=0;
+
+  // Load shedding (see shedthread): dropped channel stops tracking, shed
+  // channel does not acquire until restored
+  shed=atomget(task->shed);
+  if (shed==SHED_DROP&&sdr->flagacq) {
+    int i = sdr->prn - 1;
+    memset(&sdr->acq.aid,0,sizeof(sdracqaid_t));
+    ret = resetStructs(&sdrch[i]);
+    task->elapsed = 0; // reset elapsed acq time
+    if (ret==-1) { printf("resetStructs: error\n"); }
+    return SDRSTEP_RUN;
+  }
+  if (shed!=SHED_NONE&&!sdr->flagacq) {
+    sdrdefer(sdr,SHEDWAIT);
+    return SDRSTEP_IDLE;
+  }
 
-        snprintf(bufferSDR, sizeof(bufferSDR),
-          "%.3f  G%02d resetting with SNR of %.1f and flagacq of %d\n",
-           sdrstat.elapsedTime, sdr->prn, snr, sdr->flagacq);
-        add_message(bufferSDR);
+  // SDR Channel Reset Checks -------------------------------------------
+  // Calculate elapsed time since flagacq was set.
+  if (sdr->flagacq) {
+    task->elapsed = difftime(time(NULL), task->tacq);
+  }
 
-        // Reset struct terms
-        int i = sdr->prn - 1;
-        ret = resetStructs(&sdrch[i]);
-        elapsed_acq_time = 0; // reset elapsed acq time
-        if (ret==-1) { printf("resetStructs: error\n"); }
+  // Every 30s check SNR to make sure it is not too low
+  if (task->elapsed>60) {
+    mlock(hobsmtx);
+    snr = SNRHIST(&sdr->hist,S,0);
+    unmlock(hobsmtx);
 
-        // Continue to next iteration of while loop
-        continue;
+    // If SNR is low, set resetflag for this channel
+    if (snr<SNR_RESET_THRES) {
 
-      } // end if
-    } // end if
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d resetting with SNR of %.1f and flagacq of %d\n",
+         sdrstat.elapsedTime, sdr->prn, snr, sdr->flagacq);
+      add_message(bufferSDR);
 
-    // Check to see if tracking and nav decode is successful.
-    // Reset channel if not. Make sure GPS week is near current week (and
-    // thus non-zero).
-    // FIX: May want to not hard-code specific week for GPS week !!
-    if (elapsed_acq_time>60) {
+      // Reset struct terms
+      int i = sdr->prn - 1;
+      ret = resetStructs(&sdrch[i]);
+      task->elapsed = 0; // reset elapsed acq time
+      if (ret==-1) { printf("resetStructs: error\n"); }
 
-      // Check several nav flags
-      if (!sdr->nav.flagdec ||
-          !sdr->nav.flagsync ||
-          (sdr->nav.sdreph.week_gpst<GPS_WEEK) ) {
+      // Continue with next step
+      return SDRSTEP_RUN;
 
-        snprintf(bufferSDR, sizeof(bufferSDR),
-          "%.3f  G%02d resetting, flagdec:%d, flagsync:%d, Week:%d\n",
-               sdrstat.elapsedTime, sdr->prn, sdr->nav.flagdec, sdr->nav.flagsync,
-               sdr->nav.sdreph.week_gpst);
-        add_message(bufferSDR);
+    } // end if
+  } // end if
 
-        // Reset struct terms
-        int i = sdr->prn - 1;
-        ret = resetStructs(&sdrch[i]);
-        elapsed_acq_time = 0; // reset elapsed acq time
-        if (ret==-1) { printf("resetStructs: error\n"); }
+  // Check to see if tracking and nav decode is successful.
+  // Reset channel if not. Make sure GPS week is near current week (and
+  // thus non-zero).
+  // FIX: May want to not hard-code specific week for GPS week !!
+  if (task->elapsed>60) {
 
-        // Break out of while loop
-        continue;
-      }  // end if
-    } // end if
+    // Check several nav flags
+    if (!sdr->nav.flagdec ||
+        !sdr->nav.flagsync ||
+        (sdr->nav.sdreph.week_gpst<GPS_WEEK) ) {
 
-    // Check SV elevation
-    if (elapsed_acq_time>60) {
-      // Pull values
-      mlock(hobsmtx);
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d resetting, flagdec:%d, flagsync:%d, Week:%d\n",
+             sdrstat.elapsedTime, sdr->prn, sdr->nav.flagdec, sdr->nav.flagsync,
+             sdr->nav.sdreph.week_gpst);
+      add_message(bufferSDR);
+
+      // Reset struct terms (no aided reacquisition)
       int i = sdr->prn - 1;
-      el = sdrstat.obs_v[i*11+10];
-      unmlock(hobsmtx);
+      memset(&sdr->acq.aid,0,sizeof(sdracqaid_t));
+      ret = resetStructs(&sdrch[i]);
+      task->elapsed = 0; // reset elapsed acq time
+      if (ret==-1) { printf("resetStructs: error\n"); }
+
+      // Continue with next step
+      return SDRSTEP_RUN;
+    }  // end if
+  } // end if
 
-      // Check several nav flags
-      if (el < SV_EL_RESET_MASK) {
+  // Check SV elevation
+  if (task->elapsed>60) {
+    // Pull values
+    mlock(hobsmtx);
+    int i = sdr->prn - 1;
+    el = sdrstat.obs_v[i*11+10];
+    unmlock(hobsmtx);
 
-        snprintf(bufferSDR, sizeof(bufferSDR),
-          "%.3f  G%02d resetting, SV el: %.1f\n",
-          sdrstat.elapsedTime, i+1, el);
-        add_message(bufferSDR);
+    // Check several nav flags
+    if (el < SV_EL_RESET_MASK) {
 
-        // Reset struct terms
-        int i = sdr->prn - 1;
-        ret = resetStructs(&sdrch[i]);
-        elapsed_acq_time = 0; // reset elapsed acq time
-        if (ret==-1) { printf("resetStructs: error\n"); }
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d resetting, SV el: %.1f\n",
+        sdrstat.elapsedTime, i+1, el);
+      add_message(bufferSDR);
 
-        // Break out of while loop
-        continue;
-      }  // end if
-    } // end if
+      // Reset struct terms (no aided reacquisition)
+      int i = sdr->prn - 1;
+      memset(&sdr->acq.aid,0,sizeof(sdracqaid_t));
+      ret = resetStructs(&sdrch[i]);
+      task->elapsed = 0; // reset elapsed acq time
+      if (ret==-1) { printf("resetStructs: error\n"); }
+
+      // Continue with next step
+      return SDRSTEP_RUN;
+    }  // end if
+  } // end if
 
-    // Check if mismatch between flagacq setting and obs use for pvt
-    //checkObsDelay(sdr->prn);
+  // Check if mismatch between flagacq setting and obs use for pvt
+  //checkObsDelay(sdr->prn);
+
+  // Acquisition --------------------------------------------------------
+  if (!sdr->flagacq) {
+    // narrow search around last tracked state after loss of lock (by the
+    // acquisition workers if any, see sdracqrequest)
+    if (!sdrini.acqnthr&&sdrini.acqaid&&sdr->acq.aid.flag) {
+      task->buffloc=sdracqaided(sdr);
+      aided=sdr->flagacq;
+    }
+    if (!sdr->flagacq&&sdrini.acqnthr) {
+      // submit request to acquisition workers and receive result
+      task->buffloc=sdracqrequest(sdr);
+      aided=sdr->flagacq&&sdr->acq.prio==ACQPRIO_AID;
+    } else if (!sdr->flagacq) {
+      // search grid (narrowed by visibility prediction)
+      mlock(hacqmtx);
+      sdracqgrid(sdr);
+      skipacq=sdrini.acqvis&&sdr->acq.vis==ACQVIS_DOWN;
+      unmlock(hacqmtx);
+      if (skipacq) {
+        sdrdefer(sdr,ACQSLEEP);
+        return SDRSTEP_IDLE;
+      }
 
-    // Acquisition --------------------------------------------------------
-    if (!sdr->flagacq) {
       // memory allocation
-      if (acqpower!=NULL) free(acqpower);
-      acqpower=(double*)calloc(sizeof(double),sdr->nsamp*sdr->acq.nfreq);
+      if (task->acqpower!=NULL) free(task->acqpower);
+      task->acqpower=(float*)calloc(sizeof(float),sdr->nsamp*
+          (sdr->acq.nfreq>sdr->acq.nffreq?sdr->acq.nfreq:sdr->acq.nffreq));
 
       // fft correlation
-      buffloc=sdraqcuisition(sdr,acqpower);
+      task->buffloc=sdraqcuisition(sdr,task->acqpower);
+    }
+    if (aided) {
+      task->naided++;
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d reacquired (aided), freq: %.1f\n",
+        sdrstat.elapsedTime, sdr->prn, sdr->acq.acqfreq);
+      add_message(bufferSDR);
+    }
+
+    // Start timer. Note that this gets reset every time if flagacq = 0,
+    // but doesn't get called when flagacq is 1.
+    task->tacq = time(NULL);
+
+    // Waiting for acquisition workers is not a run
+    if (!sdr->flagacq&&sdrini.acqnthr) return SDRSTEP_IDLE;
+  }
+
+  // Tracking -----------------------------------------------------------
+  if (sdr->flagacq) {
+    if (ovrtest.on&&overrunstall(sdr)) return SDRSTEP_IDLE;
+    task->bufflocnow=sdrtracking(sdr,task->buffloc,task->cnt);
+
+    // lag behind the grabber (producer counter)
+    task->lag=task->bufflocnow+sdr->nsamp>task->buffloc?
+              task->bufflocnow+sdr->nsamp-task->buffloc:0;
+    task->lagms=1000.0*task->lag/sdr->f_sf;
+    if (task->lagms>task->lagmax) task->lagmax=task->lagms;
+
+    // Samples were overwritten in the ring: skip them by whole code periods
+    // and go on with the loop state (see trkresync)
+    if (task->overrun) {
+      task->overrun=OFF;
+      task->noverrun++;
+
+      mlock(hobsmtx);
+      buffloc=trkresync(sdr,task->buffloc,&task->cnt);
+      unmlock(hobsmtx);
+      if (buffloc) {
+        snprintf(bufferSDR, sizeof(bufferSDR),
+          "%.3f  G%02d ring overrun, lag %.0f ms, resynced %.0f ms ahead\n",
+          sdrstat.elapsedTime, sdr->prn, task->lagms,
+          1000.0*(buffloc-task->buffloc)/sdr->f_sf);
+        add_message(bufferSDR);
+        task->buffloc=buffloc;
+        task->nresync++;
+        sdr->trk.buffloc=task->buffloc;
+        return SDRSTEP_RUN;
+      }
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d ring overrun, lag %.0f ms, reacquiring\n",
+        sdrstat.elapsedTime, sdr->prn, task->lagms);
+      add_message(bufferSDR);
 
-      // Start timer. Note that this gets reset every time if flagacq = 0,
-      // but doesn't get called when flagacq is 1.
-      start_acq_timer = time(NULL);
+      // Else reacquire aided from the loop state, the aid is as old as the
+      // ring plus the lag (see sdracqaided)
+      mlock(hobsmtx);
+      sdr->acq.aid.flag=ON;
+      sdr->acq.aid.buffloc=task->buffloc;
+      sdr->acq.aid.carrfreq=sdr->trk.carrfreq;
+      sdr->acq.aid.codefreq=sdr->trk.codefreq;
+      sdr->acq.aid.age=ACQAIDAGE+task->lagms/1000.0+
+                       (double)MEMBUFFLEN*sdrstat.fendbuffsize/sdr->f_sf;
+      unmlock(hobsmtx);
+
+      int i = sdr->prn - 1;
+      ret = resetStructs(&sdrch[i]);
+      task->elapsed = 0; // reset elapsed acq time
+      if (ret==-1) { printf("resetStructs: error\n"); }
+      return SDRSTEP_RUN;
     }
 
-    // Tracking -----------------------------------------------------------
-    if (sdr->flagacq) {
-      bufflocnow=sdrtracking(sdr,buffloc,cnt);
-      if (sdr->flagtrk) {
+    // Code period out of the scratch buffers: the code loop has diverged,
+    // so reacquire (aided from the last good tracking state)
+    if (task->lostlock) {
+      task->lostlock=OFF;
+      snprintf(bufferSDR, sizeof(bufferSDR),
+        "%.3f  G%02d loss of lock, code period %d samples (max %d), "
+        "reacquiring\n", sdrstat.elapsedTime, sdr->prn, sdr->currnsamp,
+        sdr->buf.nmax);
+      add_message(bufferSDR);
 
-        // correlation output accumulation
-        cumsumcorr(&sdr->trk,sdr->nav.ocode[sdr->nav.ocodei]);
+      int i = sdr->prn - 1;
+      ret = resetStructs(&sdrch[i]);
+      task->elapsed = 0; // reset elapsed acq time
+      if (ret==-1) { printf("resetStructs: error\n"); }
+      return SDRSTEP_RUN;
+    }
+    if (!sdr->flagtrk) {
+      // first data buffer count with the samples of next code
+      task->need=(task->buffloc+sdr->nsamp)/sdrstat.fendbuffsize+1;
+      return SDRSTEP_IDLE;
+    }
 
-        sdr->trk.flagloopfilter=0;
-        if (!sdr->nav.flagsync) {
-          pll(sdr,&sdr->trk.prm1,sdr->ctime);
-          dll(sdr,&sdr->trk.prm1,sdr->ctime);
-          sdr->trk.flagloopfilter=1;
-        }
-        else if (sdr->nav.swloop) {
-          pll(sdr,&sdr->trk.prm2,(double)sdr->trk.loopms/1000);
-          dll(sdr,&sdr->trk.prm2,(double)sdr->trk.loopms/1000);
-          sdr->trk.flagloopfilter=2;
+    // correlation output accumulation
+    cumsumcorr(&sdr->trk,sdr->nav.ocode[sdr->nav.ocodei]);
 
-          mlock(hobsmtx);
-          // calculate observation data
-          if (loopcnt%(SNSMOOTHMS/sdr->trk.loopms)==0) {
-            setobsdata(sdr,buffloc,cnt,&sdr->trk,1);
-          } else {
-            setobsdata(sdr,buffloc,cnt,&sdr->trk,0);
-          }
-          unmlock(hobsmtx);
+    sdr->trk.flagloopfilter=0;
+    if (!sdr->nav.flagsync) {
+      pll(sdr,&sdr->trk.prm1,sdr->ctime);
+      dll(sdr,&sdr->trk.prm1,sdr->ctime);
+      sdr->trk.flagloopfilter=1;
+    }
+    else if (sdr->nav.swloop) {
+      pll(sdr,&sdr->trk.prm2,(double)sdr->trk.loopms/1000);
+      dll(sdr,&sdr->trk.prm2,(double)sdr->trk.loopms/1000);
+      sdr->trk.flagloopfilter=2;
 
-          // Increment loop counter
-          loopcnt++;
+      mlock(hobsmtx);
+      // calculate observation data
+      if (task->loopcnt%(SNSMOOTHMS/sdr->trk.loopms)==0) {
+        setobsdata(sdr,task->buffloc,task->cnt,&sdr->trk,1);
+      } else {
+        setobsdata(sdr,task->buffloc,task->cnt,&sdr->trk,0);
+      }
+      sdrstat.obscnt++;
+      bcastevent(hobsevent);
+
+      // keep last good tracking state for aided reacquisition
+      if (SNRHIST(&sdr->hist,S,0)>=SNR_RESET_THRES) {
+        sdr->acq.aid.flag=ON;
+        sdr->acq.aid.buffloc=task->buffloc;
+        sdr->acq.aid.carrfreq=sdr->trk.carrfreq;
+        sdr->acq.aid.codefreq=sdr->trk.codefreq;
+        sdr->acq.aid.age=0.0;
+      }
+      unmlock(hobsmtx);
 
-        } // end else if
+      // Increment loop counter
+      task->loopcnt++;
 
-        if (sdr->trk.flagloopfilter) clearcumsumcorr(&sdr->trk);
-        cnt++;
-        buffloc+=sdr->currnsamp;
+    } // end else if
 
-      } // end tracking if (flagtrk)
-    } // end tracking if (flagacq)
+    if (sdr->trk.flagloopfilter) clearcumsumcorr(&sdr->trk);
+    task->cnt++;
+    task->buffloc+=sdr->currnsamp;
 
-    sdr->trk.buffloc=buffloc;
-  } // end while
+  } // end tracking if (flagacq)
+
+  sdr->trk.buffloc=task->buffloc;
+  return SDRSTEP_RUN;
+}
+
+// sdr channel finish ---------------------------------------------------------
+// report and release channel task after the workers have stopped
+// args   : sdrch_t *sdr     I/O sdr channel struct
+// return : none
+//-----------------------------------------------------------------------------
+extern void sdrchfinish(sdrch_t *sdr)
+{
+  sdrtask_t *task=&sdr->task;
 
-  // Thread finished
   if (sdr->flagacq) {
-    SDRPRINTF("SDR channel %s thread finished! Delay=%d [ms]\n",
-               sdr->satstr,(int)(bufflocnow-buffloc)/sdr->nsamp);
+    SDRPRINTF("SDR channel %s finished! Delay=%.0f [ms] (max %.0f, "
+               "overruns %lu, resyncs %lu) Tracking sdrmalloc/cpxmalloc=%lu "
+               "code bank=%lu/%lu\n",sdr->satstr,task->lagms,task->lagmax,
+               task->noverrun,task->nresync,sdr->buf.nalloc,sdr->cbank.nuse,
+               sdr->cbank.nuse+sdr->cbank.nfall);
   } else {
-    SDRPRINTF("SDR channel %s thread finished!\n",sdr->satstr);
+    SDRPRINTF("SDR channel %s finished!\n",sdr->satstr);
+  }
+  free(task->acqpower);
+  task->acqpower=NULL;
+}
+
+// Channel worker deque -------------------------------------------------------
+// Each worker runs the channel tasks of its own deque in turn (a task goes
+// back to the deque of the worker that ran it, so channels stay on the same
+// core). An idle worker steals the next task of a worker that has more
+// tasks than itself or is stuck in a long step (acquisition).
+//-----------------------------------------------------------------------------
+static void pushtask(sdrworker_t *w, int k, int *n)
+{
+  mlock(w->hmtx);
+  w->ch[(w->head+w->n)%MAXSAT]=k;
+  w->n++;
+  w->tbusy=0;
+  if (n) *n=w->n;
+  unmlock(w->hmtx);
+}
+static int poptask(sdrworker_t *w)
+{
+  int k=-1;
+
+  mlock(w->hmtx);
+  if (w->n>0) {
+    k=w->ch[w->head];
+    w->head=(w->head+1)%MAXSAT;
+    w->n--;
+  }
+  unmlock(w->hmtx);
+  return k;
+}
+static int stealtask(sdrworker_t *w)
+{
+  sdrworker_t *v;
+  unsigned long tick=tickgetus()/1000;
+  int i,k=-1,n;
+
+  mlock(w->hmtx);
+  n=w->n;
+  unmlock(w->hmtx);
+
+  for (i=1;i<sdrini.nworker&&k<0;i++) {
+    v=&sdrworker[(w->no+i)%sdrini.nworker];
+    mlock(v->hmtx);
+    if (v->n>0&&(v->n>n+1||(v->tbusy&&tick-v->tbusy>WORKSTEAL))) {
+      k=v->ch[v->head];
+      v->head=(v->head+1)%MAXSAT;
+      v->n--;
+    }
+    unmlock(v->hmtx);
+  }
+  if (k>=0) w->nsteal++;
+  return k;
+}
+
+// Channel worker thread ------------------------------------------------------
+// run steps of sdr channel tasks (see sdrchstep)
+// args   : void   *arg      I   channel worker struct
+// return : none
+// note : sdrini.nworker workers are created at startsdr function, each
+//        pinned to one of the real-time cpus. When no task has anything to
+//        do the worker waits for the samples the tasks need (rcvwaitbuff),
+//        the next deferred step or WORKSTEAL ms, whichever comes first.
+//-----------------------------------------------------------------------------
+static void idlewait(uint64_t need, unsigned long tnext)
+{
+  unsigned long tick=tickgetus()/1000;
+  int ms=WORKSTEAL;
+
+  if (tnext) {
+    if (tnext<=tick) return;
+    if (tnext-tick<(unsigned long)ms) ms=(int)(tnext-tick);
+  }
+  rcvwaitbuff(need?need:UINT64_MAX,ms);
+}
+extern void *sdrworkthread(void *arg)
+{
+  sdrworker_t *w=(sdrworker_t*)arg;
+  sdrtask_t *task;
+  cpu_set_t cpus;
+  uint64_t need=0;
+  unsigned long tnext=0;
+  int k,n=0,nidle=0;
+
+  // Pin to the cpu so that channel data stay in its cache
+  if (w->cpu>=0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(w->cpu,&cpus);
+    if (pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&cpus)) {
+      SDRPRINTF("warning: channel worker %d not pinned to cpu %d\n",
+                w->no,w->cpu);
+    }
   }
 
+  while (!sdrstat.stopflag) {
+    // Own task first, then steal
+    if ((k=poptask(w))<0&&(k=stealtask(w))<0) {
+      idlewait(0,0);
+      continue;
+    }
+    mlock(w->hmtx);
+    w->tbusy=tickgetus()/1000;
+    unmlock(w->hmtx);
+
+    task=&sdrch[k].task;
+    if (sdrchstep(&sdrch[k])==SDRSTEP_RUN) {
+      nidle=0; need=0; tnext=0;
+    } else {
+      // earliest event the idle tasks wait for
+      nidle++;
+      if (task->need&&(!need||task->need<need)) need=task->need;
+      if (task->tnext&&(!tnext||task->tnext<tnext)) tnext=task->tnext;
+    }
+    w->nstep++;
+    pushtask(w,k,&n);
+
+    // No task of the deque had anything to do: balance, then wait
+    if (nidle>=n) {
+      if ((k=stealtask(w))>=0) {
+        pushtask(w,k,&n);
+      } else {
+        idlewait(need,tnext);
+      }
+      nidle=0; need=0; tnext=0;
+    }
+  }
   return THRETVAL;
 }
 
@@ -584,8 +1021,14 @@ extern int resetStructs(void *arg)
   int prn = sdr->prn;
   int i = prn-1;
   char bufferReset[MSG_LENGTH];
-
-  // Reset all values in sdrch[i]
+  sdracqaid_t aid = sdr->acq.aid; // kept for aided reacquisition
+  sdrtask_t task = sdr->task; // channel task state
+  int aided = sdrini.acqaid&&aid.flag;
+
+  // Reset all values in sdrch[i] (acquisition workers must not see the
+  // channel while it is being re-initialized)
+  mlock(hacqmtx);
+  freesdrch(&sdrch[i]);
   memset(&sdrch[i], 0, sizeof(sdrch_t));
 
   // Reset sdrstat flags (may be better to use nav timer by channel)
@@ -603,16 +1046,29 @@ extern int resetStructs(void *arg)
       quitsdr(&sdrini,2);
       //return;
   }
+  sdrch[i].acq.aid = aid;
+  sdrch[i].task = task;
+  unmlock(hacqmtx);
   unmlock(hobsvecmtx);
 
+  // Aided reacquisition starts right away (see sdracqaided)
+  if (aided) {
+    snprintf(bufferReset, sizeof(bufferReset),
+       "%.3f  resetStructs: G%02d channel has been reset, aided reacquisition",
+       sdrstat.elapsedTime, prn);
+    add_message(bufferReset);
+    return 0;
+  }
+
   // Announce channel reset
   snprintf(bufferReset, sizeof(bufferReset),
      "%.3f  resetStructs: G%02d channel has been reset and will reacquire in 10s",
      sdrstat.elapsedTime, prn);
   add_message(bufferReset);
 
-  // Pause a bit before continuing to reacquire
-  sleepms(10000);
+  // Pause a bit before continuing to reacquire (the worker running the
+  // channel goes on with other channels)
+  sdrdefer(&sdrch[i],CHRESETWAIT);
 
   return 0;
 }
@@ -654,6 +1110,7 @@ extern int checkObsDelay(int prn)
      sdrstat.elapsedTime, prn);
     add_message(bufferReset);
 
+    memset(&sdrch[i].acq.aid,0,sizeof(sdracqaid_t));
     ret = resetStructs(&sdrch[i]);
     if (ret==-1) { printf("resetStructs: error\n"); }
   }
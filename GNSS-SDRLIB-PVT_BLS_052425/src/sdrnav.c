@@ -279,10 +279,9 @@ extern int checkbit(double IP, int loopms, sdrnav_t *nav)
         }
         nav->bit=(nav->bitIP<0)?-polarity:polarity;
 
-        /* set bit*/
-        shiftdata(&nav->fbits[0],&nav->fbits[1],sizeof(int),
-            nav->flen+nav->addflen-1); /* shift to left */
-        nav->fbits[nav->flen+nav->addflen-1]=nav->bit; /* add last */
+        /* set bit (overwrite oldest) */
+        nav->fbits[nav->fbitsi]=nav->bit;
+        nav->fbitsi=(nav->fbitsi+1)%(nav->flen+nav->addflen);
         nav->swsync=ON;
     }
     nav->cnt++;
@@ -297,7 +296,7 @@ extern int checkbit(double IP, int loopms, sdrnav_t *nav)
 *-----------------------------------------------------------------------------*/
 extern void predecodefec(sdrnav_t *nav)
 {
-    int i,j;
+    int i,j,n=nav->flen+nav->addflen;
     unsigned char enc[NAVFLEN_SBAS+NAVADDFLEN_SBAS];
     unsigned char dec[94];
     int dec2[NAVFLEN_SBAS/2];
@@ -306,8 +305,11 @@ extern void predecodefec(sdrnav_t *nav)
     //if (nav->ctype==CTYPE_L1CA ||
     //    nav->ctype==CTYPE_E1B) {
     if (nav->ctype==CTYPE_L1CA) {
-        /* FEC is not used before preamble detection */
-        memcpy(nav->fbitsdec,nav->fbits,sizeof(int)*(nav->flen+nav->addflen));
+        /* FEC is not used before preamble detection (unwrap frame ring) */
+        memcpy(nav->fbitsdec,nav->fbits+nav->fbitsi,
+               sizeof(int)*(n-nav->fbitsi));
+        memcpy(nav->fbitsdec+n-nav->fbitsi,nav->fbits,
+               sizeof(int)*nav->fbitsi);
     }
     /* SBAS L1 / QZS L1SAIF */
     //if (nav->ctype==CTYPE_L1SAIF||
@@ -316,7 +318,7 @@ extern void predecodefec(sdrnav_t *nav)
         /* 1/2 convolutional code */
         init_viterbi27_port(nav->fec,0);
         for (i=0;i<NAVFLEN_SBAS+NAVADDFLEN_SBAS;i++)
-            enc[i]=(nav->fbits[i]==1)? 0:255;
+            enc[i]=(nav->fbits[(nav->fbitsi+i)%n]==1)? 0:255;
         update_viterbi27_blk_port(nav->fec,enc,(nav->flen+nav->addflen)/2);
         chainback_viterbi27_port(nav->fec,dec,nav->flen/2,0);
         for (i=0;i<94;i++) {
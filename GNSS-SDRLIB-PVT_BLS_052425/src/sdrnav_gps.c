@@ -95,6 +95,46 @@ void decode_subfrm3(const uint8_t *buff, sdreph_t *eph)
     /* subframe counter */
     eph->cnt++;
 }
+/* decode GPS almanac page ----------------------------------------------------
+* decode almanac of subframe 4 (pages of sv 25-32) or 5 (pages of sv 1-24)
+* and store it to sdrstat.alm
+* args   : uint8_t  *buff   I   navigation data bits (subframe 4/5)
+* return : none
+* note : pages with other data (sv id 0 or >32) and implausible orbits are
+*        discarded
+*-----------------------------------------------------------------------------*/
+static void decode_alm(const uint8_t *buff)
+{
+    sdralm_t alm={0};
+    double deltai,sqrtA;
+    int dataid,svid;
+
+    dataid      =getbitu( buff, 60, 2);
+    svid        =getbitu( buff, 62, 6);
+    if (dataid!=1||svid<1||svid>MAXSAT) return;
+
+    alm.e       =getbitu( buff, 68,16)*P2_21;
+    alm.toas    =getbitu( buff, 90, 8)*4096.0;
+    deltai      =getbits( buff, 98,16)*P2_19;
+    alm.OMGd    =getbits( buff,120,16)*P2_38*SC2RAD;
+    alm.svh     =getbitu( buff,136, 8);
+    sqrtA       =getbitu( buff,150,24)*P2_11;
+    alm.OMG0    =getbits( buff,180,24)*P2_23*SC2RAD;
+    alm.omg     =getbits( buff,210,24)*P2_23*SC2RAD;
+    alm.M0      =getbits( buff,240,24)*P2_23*SC2RAD;
+    alm.f0      =getbits2(buff,270, 8,289, 3)*P2_20;
+    alm.f1      =getbits( buff,278,11)*P2_38;
+    alm.i0      =(0.3+deltai)*SC2RAD;
+    alm.A       =sqrtA*sqrtA;
+
+    /* GPS orbit sanity check (semi-major axis 26560km) */
+    if (sqrtA<5000.0||sqrtA>5300.0||alm.e>0.1) return;
+    alm.flag=ON;
+
+    mlock(hobsvecmtx);
+    sdrstat.alm[svid-1]=alm;
+    unmlock(hobsvecmtx);
+}
 /* decode GPS/QZS navigation data (subframe 4) ---------------------------------
 *
 * args   : uint8_t  *buff   I   navigation data bits
@@ -104,6 +144,9 @@ void decode_subfrm3(const uint8_t *buff, sdreph_t *eph)
 void decode_subfrm4(const uint8_t *buff, sdreph_t *eph)
 {
     eph->tow_gpst=getbitu(buff,30,17)*6.0; /* transmission time of subframe */
+
+    /* almanac (pages 2-5,7-10) */
+    decode_alm(buff);
 }
 /* decode GPS/QZS navigation data (subframe 5) ---------------------------------
 *
@@ -114,6 +157,9 @@ void decode_subfrm4(const uint8_t *buff, sdreph_t *eph)
 void decode_subfrm5(const uint8_t *buff, sdreph_t *eph)
 {
     eph->tow_gpst=getbitu(buff,30,17)*6.0; /* transmission time of subframe */
+
+    /* almanac (pages 1-24) */
+    decode_alm(buff);
 }
 /* decode navigation data (GPS/QZS L1CA subframe) ------------------------------
 *
@@ -122,7 +122,7 @@ extern int decode_l1sbas(sdrnav_t *nav)
 
     /* tentative: get tow from other channel */
     if (sdrini.nch>1&&sdrch[sdrini.nch-2].nav.sdreph.week_gpst!=0) {
-        nav->sbas.tow=sdrch[sdrini.nch-2].trk.tow[0];
+        nav->sbas.tow=OBSHIST(&sdrch[sdrini.nch-2].hist,tow,0);
         nav->sbas.week=sdrch[sdrini.nch-2].nav.sdreph.week_gpst;
     }
 
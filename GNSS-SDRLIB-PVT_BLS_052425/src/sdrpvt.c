@@ -1218,3 +1218,107 @@ extern int updateObsList(void) {
 
   return 0;
 }
+
+//-----------------------------------------------------------------------------
+// Predict visibility and Doppler of the GPS satellites from the decoded
+// almanac and the current PVT solution. The receiver clock frequency offset
+// is taken from the channels in track. Results are written to the acq
+// struct of each channel for the acquisition workers (see sdracqgrid).
+//-----------------------------------------------------------------------------
+extern int visPredict(double tow)
+{
+  sdralm_t alm[MAXSAT];
+  sdreph_t eph;
+  double X[3], dx[3], xs0[3], xs1[3];
+  double az, D, D1, svClkCorr;
+  double el_v[MAXSAT], dop_v[MAXSAT];
+  double dclk = 0.0;
+  int vis_v[MAXSAT];
+  int nclk = 0;
+  int nvis = 0;
+  int prn;
+
+  // Pull receiver position and almanac
+  mlock(hobsvecmtx);
+  for (int i=0; i<3; i++) {
+    X[i] = sdrstat.xyzdt[i];
+  }
+  memcpy(alm, sdrstat.alm, sizeof(alm));
+  unmlock(hobsvecmtx);
+
+  if (X[0]==0.0 && X[1]==0.0 && X[2]==0.0) {
+    return -1;
+  }
+
+  // Elevation and Doppler of each PRN with almanac
+  for (int i=0; i<MAXSAT; i++) {
+    vis_v[i] = ACQVIS_UNKNOWN;
+    if (!alm[i].flag) continue;
+
+    // Almanac orbit as ephemeris without harmonic corrections
+    memset(&eph, 0, sizeof(eph));
+    eph.eph.toes = alm[i].toas;
+    eph.eph.A    = alm[i].A;
+    eph.eph.e    = alm[i].e;
+    eph.eph.i0   = alm[i].i0;
+    eph.eph.OMG0 = alm[i].OMG0;
+    eph.eph.omg  = alm[i].omg;
+    eph.eph.M0   = alm[i].M0;
+    eph.eph.OMGd = alm[i].OMGd;
+
+    if (satPos(&eph, tow, xs0, &svClkCorr)!=0 ||
+        satPos(&eph, tow+1.0, xs1, &svClkCorr)!=0) {
+      continue;
+    }
+    for (int k=0; k<3; k++) {
+      dx[k] = xs0[k] - X[k];
+    }
+    topocent(X, dx, &az, &el_v[i], &D);
+
+    // Doppler from 1s range difference (receiver fixed in ECEF)
+    D1 = sqrt( (xs1[0]-X[0]) * (xs1[0]-X[0]) +
+               (xs1[1]-X[1]) * (xs1[1]-X[1]) +
+               (xs1[2]-X[2]) * (xs1[2]-X[2]) );
+    dop_v[i] = -(D1 - D) * FREQ1 / CTIME;
+
+    if (alm[i].svh==0 && el_v[i]>=SV_EL_RESET_MASK) {
+      vis_v[i] = ACQVIS_UP;
+      nvis++;
+    } else {
+      vis_v[i] = ACQVIS_DOWN;
+    }
+  }
+
+  // Receiver clock frequency offset (measured minus predicted Doppler)
+  mlock(hobsmtx);
+  for (int i=0; i<sdrini.nch; i++) {
+    prn = sdrch[i].prn;
+    if (sdrch[i].ctype!=CTYPE_L1CA || prn<1 || prn>MAXSAT) continue;
+    if (!sdrch[i].flagacq || !sdrch[i].nav.swloop ||
+        SNRHIST(&sdrch[i].hist,S,0)<SNR_PVT_THRES ||
+        vis_v[prn-1]==ACQVIS_UNKNOWN) continue;
+    dclk += OBSHIST(&sdrch[i].hist,D,0) - dop_v[prn-1];
+    nclk++;
+  }
+  unmlock(hobsmtx);
+
+  if (nclk==0) {
+    return -1;
+  }
+  dclk /= nclk;
+
+  // Load predictions into channel acq structs
+  mlock(hacqmtx);
+  for (int i=0; i<sdrini.nch; i++) {
+    prn = sdrch[i].prn;
+    if (sdrch[i].ctype!=CTYPE_L1CA || prn<1 || prn>MAXSAT) continue;
+    sdrch[i].acq.vis = vis_v[prn-1];
+    if (vis_v[prn-1]==ACQVIS_UNKNOWN) continue;
+    sdrch[i].acq.visel = el_v[prn-1];
+    sdrch[i].acq.visfreq = sdrch[i].f_if + sdrch[i].foffset -
+                           (dop_v[prn-1] + dclk);
+  }
+  unmlock(hacqmtx);
+
+  return nvis;
+}
@@ -6,6 +6,31 @@
 //-----------------------------------------------------------------------------
 #include "sdr.h"
 
+/* memory buffer allocation ----------------------------------------------------
+* allocate memory buffer as mirrored ring (see ringalloc), plain memory if
+* not available
+* args   : size_t size      I   buffer size (bytes)
+*          size_t *ringsize O   ring size (0: plain memory)
+* return : uint8_t*             memory buffer (NULL: error)
+*-----------------------------------------------------------------------------*/
+static uint8_t *rcvalloc(size_t size, size_t *ringsize)
+{
+        uint8_t *p;
+
+        if ((p=(uint8_t*)ringalloc(size))!=NULL) {
+                *ringsize=size;
+                return p;
+        }
+        *ringsize=0;
+        return (uint8_t*)malloc(size);
+}
+static void rcvfree(uint8_t *p, size_t *ringsize)
+{
+        if (*ringsize) ringfree(p,*ringsize);
+        else free(p);
+        *ringsize=0;
+}
+
 /* sdr receiver initialization -------------------------------------------------
 * receiver initialization, memory allocation, file open
 * args   : sdrini_t *ini    I   sdr initialization struct
@@ -15,6 +40,7 @@ extern int rcvinit(sdrini_t *ini)
 {
         /* FFT initialization */
         fftwf_init_threads();
+        fftinit(ini->fftwisdom,ini->fftplanner);
 
         sdrstat.buff=sdrstat.buff2=sdrstat.tmpbuff=NULL;
 
@@ -25,11 +51,16 @@ extern int rcvinit(sdrini_t *ini)
         case FEND_BLADERF:
                 if (bladerf_init()<0) return -1; /* bladeRF initialization */
 
+                /* SC16 I/Q stored as 8 bit (DTYPEIQ) or native 16 bit (DTYPEIQ16) */
+                if (ini->dtype[0]!=DTYPEIQ&&ini->dtype[0]!=DTYPEIQ16) {
+                        SDRPRINTF("error: bladeRF data type must be 2 or 4\n");
+                        return -1;
+                }
                 sdrstat.fendbuffsize=BLADERF_DATABUFF_SIZE; /* frontend buff size */
-                sdrstat.buffsize=2*BLADERF_DATABUFF_SIZE*MEMBUFFLEN; /* total */
+                sdrstat.buffsize=ini->dtype[0]*BLADERF_DATABUFF_SIZE*MEMBUFFLEN;
 
                 /* memory allocation */
-                sdrstat.buff=(uint8_t*)malloc(sdrstat.buffsize);
+                sdrstat.buff=rcvalloc(sdrstat.buffsize,&sdrstat.ringsize);
                 if (NULL==sdrstat.buff) {
                         SDRPRINTF("error: failed to allocate memory for the buffer\n");
                         return -1;
@@ -43,12 +74,18 @@ extern int rcvinit(sdrini_t *ini)
                         SDRPRINTF("error: failed to open file : %s\n",ini->file1);
                         return -1;
                 }
+                bladerf_dcreset(); /* DC offset estimate of new file */
 
+                /* SC16 I/Q stored as 8 bit (DTYPEIQ) or native 16 bit (DTYPEIQ16) */
+                if (ini->dtype[0]!=DTYPEIQ&&ini->dtype[0]!=DTYPEIQ16) {
+                        SDRPRINTF("error: bladeRF data type must be 2 or 4\n");
+                        return -1;
+                }
                 sdrstat.fendbuffsize=BLADERF_DATABUFF_SIZE; /* frontend buff size */
-                sdrstat.buffsize=2*BLADERF_DATABUFF_SIZE*MEMBUFFLEN; /* total */
+                sdrstat.buffsize=ini->dtype[0]*BLADERF_DATABUFF_SIZE*MEMBUFFLEN;
 
                 /* memory allocation */
-                sdrstat.buff=(uint8_t*)malloc(sdrstat.buffsize);
+                sdrstat.buff=rcvalloc(sdrstat.buffsize,&sdrstat.ringsize);
                 if (NULL==sdrstat.buff) {
                         SDRPRINTF("error: failed to allocate memory for the buffer\n");
                         return -1;
@@ -66,7 +103,7 @@ extern int rcvinit(sdrini_t *ini)
                 sdrstat.buffsize=2*RTLSDR_DATABUFF_SIZE*MEMBUFFLEN; /* total */
 
                 /* memory allocation */
-                sdrstat.buff=(uint8_t*)malloc(sdrstat.buffsize);
+                sdrstat.buff=rcvalloc(sdrstat.buffsize,&sdrstat.ringsize);
                 if (NULL==sdrstat.buff) {
                         SDRPRINTF("error: failed to allocate memory for the buffer\n");
                         return -1;
@@ -86,7 +123,7 @@ extern int rcvinit(sdrini_t *ini)
                 sdrstat.buffsize=2*RTLSDR_DATABUFF_SIZE*MEMBUFFLEN; /* total */
 
                 /* memory allocation */
-                sdrstat.buff=(uint8_t*)malloc(sdrstat.buffsize);
+                sdrstat.buff=rcvalloc(sdrstat.buffsize,&sdrstat.ringsize);
                 if (NULL==sdrstat.buff) {
                         SDRPRINTF("error: failed to allocate memory for the buffer\n");
                         return -1;
@@ -116,14 +153,16 @@ extern int rcvinit(sdrini_t *ini)
 
                 /* memory allocation */
                 if (ini->fp1!=NULL) {
-                        sdrstat.buff=(uint8_t*)malloc(ini->dtype[0]*sdrstat.buffsize);
+                        sdrstat.buff=rcvalloc(ini->dtype[0]*sdrstat.buffsize,
+                                           &sdrstat.ringsize);
                         if (NULL==sdrstat.buff) {
                                 SDRPRINTF("error: failed to allocate memory for the buffer\n");
                                 return -1;
                         }
                 }
                 if (ini->fp2!=NULL) {
-                        sdrstat.buff2=(uint8_t*)malloc(ini->dtype[1]*sdrstat.buffsize);
+                        sdrstat.buff2=rcvalloc(ini->dtype[1]*sdrstat.buffsize,
+                                            &sdrstat.ringsize2);
                         if (NULL==sdrstat.buff2) {
                                 SDRPRINTF("error: failed to allocate memory for the buffer\n");
                                 return -1;
@@ -185,11 +224,11 @@ extern int rcvquit(sdrini_t *ini)
 
         /* free memory */
         if (NULL!=sdrstat.buff) {
-          free(sdrstat.buff);
+          rcvfree(sdrstat.buff,&sdrstat.ringsize);
           sdrstat.buff=NULL;
         }
         if (NULL!=sdrstat.buff2) {
-          free(sdrstat.buff2);
+          rcvfree(sdrstat.buff2,&sdrstat.ringsize2);
           sdrstat.buff2=NULL;
         }
         if (NULL!=sdrstat.tmpbuff) {
@@ -272,9 +311,10 @@ extern int rcvgrabdata(sdrini_t *ini)
 *          uint64_t buffloc I   buffer location
 *          int    n         I   number of grab data
 *          int    ftype     I   front end type (FTYPE1 or FTYPE2)
-*          int    dtype     I   data type (DTYPEI or DTYPEIQ)
+*          int    dtype     I   data type (DTYPEI, DTYPEIQ or DTYPEIQ16)
 *          char   *expbuff  O   extracted data buffer
-* return : int                  status 0:okay -1:failure
+* return : int                  status 0:okay -1:failure (or data overwritten
+*                               by the grabber while copying)
 *-----------------------------------------------------------------------------*/
 extern int rcvgetbuff(sdrini_t *ini, uint64_t buffloc, int n, int ftype,
                       int dtype, char *expbuf)
@@ -312,7 +352,125 @@ extern int rcvgetbuff(sdrini_t *ini, uint64_t buffloc, int n, int ftype,
         default:
                 return -1;
         }
-        return 0;
+        return rcvcheckbuff(buffloc)?0:-1;
+}
+
+/* start writing data buffer ---------------------------------------------------
+* mark the next memory buffer as being written (called by the grabber before
+* the buffer data are written, then rcvpushbuff after)
+* args   : none
+* return : int                  memory buffer index to write (0-MEMBUFFLEN-1)
+* notes  : the memory buffer is a lock-free ring with one writer (grabber) and
+*          many readers (channels and acquisition), readers check the data
+*          copied against overwrite by rcvcheckbuff (seqlock)
+*-----------------------------------------------------------------------------*/
+extern int rcvwritebuff(void)
+{
+        uint64_t cnt=sdrstat.buffcnt;
+
+        __atomic_store_n(&sdrstat.wrtcnt,cnt+1,__ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return (int)(cnt%MEMBUFFLEN);
+}
+
+/* publish data buffer ---------------------------------------------------------
+* count one front end data buffer as received and wake up the consumers
+* waiting for it (called by the grabber after the buffer data are written)
+* args   : none
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void rcvpushbuff(void)
+{
+        atomset(sdrstat.buffcnt,sdrstat.buffcnt+1);
+
+        /* lock only if someone waits (see rcvwaitbuff) */
+        if (atomget(sdrstat.nwait)>0) {
+                mlock(hreadmtx);
+                bcastevent(hreadevent);
+                unmlock(hreadmtx);
+        }
+}
+
+/* current data buffer count ---------------------------------------------------
+* number of data buffers published by the grabber
+* args   : none
+* return : uint64_t             buffer count
+*-----------------------------------------------------------------------------*/
+extern uint64_t rcvbuffcnt(void)
+{
+        return atomget(sdrstat.buffcnt);
+}
+
+/* check data buffer -----------------------------------------------------------
+* check that data copied from buffer location were not overwritten by the
+* grabber while copying (call after the copy)
+* args   : uint64_t buffloc I   buffer location of first sample copied
+* return : int                  1: valid, 0: overwritten (reader too late)
+*-----------------------------------------------------------------------------*/
+extern int rcvcheckbuff(uint64_t buffloc)
+{
+        uint64_t cnt;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        cnt=__atomic_load_n(&sdrstat.wrtcnt,__ATOMIC_RELAXED);
+        return buffloc/sdrstat.fendbuffsize+MEMBUFFLEN>=cnt;
+}
+
+/* wait data buffer ------------------------------------------------------------
+* wait until data buffer count reaches cnt (no polling, see rcvpushbuff)
+* args   : uint64_t cnt     I   buffer count to wait for
+*          int    ms        I   max wait time (ms)
+* return : int                  1: available, 0: timeout or stop
+*-----------------------------------------------------------------------------*/
+extern int rcvwaitbuff(uint64_t cnt, int ms)
+{
+        struct timespec timeout;
+        int ret=0;
+
+        if (rcvbuffcnt()>=cnt) return 1;
+
+        settimeout(&timeout,ms);
+        mlock(hreadmtx);
+        atomadd(sdrstat.nwait,1);
+        while (rcvbuffcnt()<cnt&&!sdrstat.stopflag&&!ret) {
+                ret=timedwaitevent(hreadevent,hreadmtx,&timeout);
+        }
+        atomadd(sdrstat.nwait,-1);
+        unmlock(hreadmtx);
+        return rcvbuffcnt()>=cnt;
+}
+
+/* view current buffer ---------------------------------------------------------
+* get read-only pointer to data in memory buffer instead of a copy
+* args   : sdrini_t *ini    I   sdr initialization struct
+*          uint64_t buffloc I   buffer location
+*          int    n         I   number of data
+*          int    ftype     I   front end type (FTYPE1 or FTYPE2)
+*          int    dtype     I   data type (DTYPEI, DTYPEIQ or DTYPEIQ16)
+* return : const char*          data (NULL: not available, use rcvgetbuff)
+* notes  : available for memory buffers allocated as mirrored ring, so no
+*          window wraps (front end samples are converted at ingest). Like a
+*          copy, the data can be checked against overwrite by rcvcheckbuff
+*          after use.
+*-----------------------------------------------------------------------------*/
+extern const char *rcvviewbuff(sdrini_t *ini, uint64_t buffloc, int n,
+                               int ftype, int dtype)
+{
+        const uint8_t *buff=NULL;
+        size_t ringsize=0;
+
+        if (ftype==FTYPE1) {
+                buff=sdrstat.buff;
+                ringsize=sdrstat.ringsize;
+        }
+        if (ftype==FTYPE2) {
+                buff=sdrstat.buff2;
+                ringsize=sdrstat.ringsize2;
+        }
+        /* window incl. read-ahead of simd kernels within the mapping */
+        if (!buff||!ringsize||(size_t)dtype*(n+100)>ringsize) return NULL;
+
+        return (const char *)&buff[dtype*buffloc%ringsize];
 }
 
 /* push data to memory buffer --------------------------------------------------
@@ -323,19 +481,18 @@ extern int rcvgetbuff(sdrini_t *ini, uint64_t buffloc, int n, int ftype,
 extern void file_pushtomembuf(void)
 {
         size_t nread1=0,nread2=0;
+        int ind=rcvwritebuff();
 
-        mlock(hbuffmtx);
         if(sdrini.fp1!=NULL) {
-                nread1=fread(&sdrstat.buff[(sdrstat.buffcnt%MEMBUFFLEN)*
+                nread1=fread(&sdrstat.buff[ind*
                                            sdrini.dtype[0]*FILE_BUFFSIZE],1,sdrini.dtype[0]*FILE_BUFFSIZE,
                              sdrini.fp1);
         }
         if(sdrini.fp2!=NULL) {
-                nread2=fread(&sdrstat.buff2[(sdrstat.buffcnt%MEMBUFFLEN)*
+                nread2=fread(&sdrstat.buff2[ind*
                                             sdrini.dtype[1]*FILE_BUFFSIZE],1,sdrini.dtype[1]*FILE_BUFFSIZE,
                              sdrini.fp2);
         }
-        unmlock(hbuffmtx);
 
         if ((sdrini.fp1!=NULL&&(int)nread1<sdrini.dtype[0]*FILE_BUFFSIZE)||
             (sdrini.fp2!=NULL&&(int)nread2<sdrini.dtype[1]*FILE_BUFFSIZE)) {
@@ -343,9 +500,7 @@ extern void file_pushtomembuf(void)
                 SDRPRINTF("end of file!\n");
         }
 
-        mlock(hreadmtx);
-        sdrstat.buffcnt++;
-        unmlock(hreadmtx);
+        rcvpushbuff();
 }
 
 /* get current data buffer from IF file ----------------------------------------
@@ -353,7 +508,7 @@ extern void file_pushtomembuf(void)
 * args   : uint64_t buffloc I   buffer location
 *          int    n         I   number of grab data
 *          int    ftype     I   front end type (FTYPE1 or FTYPE2)
-*          int    dtype     I   data type (DTYPEI or DTYPEIQ)
+*          int    dtype     I   data type (DTYPEI, DTYPEIQ or DTYPEIQ16)
 *          char   *expbuff  O   extracted data buffer
 * return : none
 *-----------------------------------------------------------------------------*/
@@ -366,7 +521,6 @@ extern void file_getbuff(uint64_t buffloc, int n, int ftype, int dtype,
         n=dtype*n;
         nout=(int)((membuffloc+n)-(MEMBUFFLEN*dtype*FILE_BUFFSIZE));
 
-        mlock(hbuffmtx);
         if (ftype==FTYPE1) {
                 if (nout>0) {
                         memcpy(expbuf,&sdrstat.buff[membuffloc],n-nout);
@@ -383,5 +537,4 @@ extern void file_getbuff(uint64_t buffloc, int n, int ftype, int dtype,
                         memcpy(expbuf,&sdrstat.buff2[membuffloc],n);
                 }
         }
-        unmlock(hbuffmtx);
 }
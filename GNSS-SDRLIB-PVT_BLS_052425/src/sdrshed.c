@@ -0,0 +1,204 @@
+//-----------------------------------------------------------------------------
+// sdrshed.c : SDR load shedding supervisor
+//
+// Edits from Don Kelly, don.kelly@mac.com, 2025
+//-----------------------------------------------------------------------------
+#include "sdr.h"
+
+// cpu load -------------------------------------------------------------------
+// process cpu time per wall time of the real-time cpus since the last call
+// args   : double *tcpu     I/O process cpu time of last call (s)
+//          double *twall    I/O wall time of last call (s)
+//          int    ncpu      I   number of real-time cpus
+// return : double               cpu load (%) (0 at first call)
+//-----------------------------------------------------------------------------
+static double cpuload(double *tcpu, double *twall, int ncpu)
+{
+    struct timespec ts;
+    double c,w,load=0.0;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+    c=ts.tv_sec+ts.tv_nsec*1E-9;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    w=ts.tv_sec+ts.tv_nsec*1E-9;
+
+    if (*twall>0.0&&w>*twall) load=100.0*(c-*tcpu)/((w-*twall)*ncpu);
+    *tcpu=c;
+    *twall=w;
+    return load;
+}
+
+// likely acquisition ---------------------------------------------------------
+// satellite predicted above the mask or lost lately (see sdracqrequest)
+// args   : sdrch_t *sdr     I   sdr channel struct
+// return : int                  1: likely, 0: unlikely to be acquired
+//-----------------------------------------------------------------------------
+static int acqlikely(const sdrch_t *sdr)
+{
+    uint64_t loc;
+
+    if (sdrini.acqvis&&sdr->acq.vis==ACQVIS_UP) return 1;
+    if (sdr->acq.aid.buffloc>0) {
+        loc=sdrstat.fendbuffsize*rcvbuffcnt();
+        return loc<sdr->acq.aid.buffloc+(uint64_t)(ACQLOSTAGE*sdr->f_sf);
+    }
+    return 0;
+}
+
+// drop tracking channel ------------------------------------------------------
+// drop the tracking channel of lowest C/N0 if more than sdrini.shedminch
+// channels are tracked (the best ones are kept for PVT geometry)
+// args   : none
+// return : int                  1: dropped, 0: no channel to drop
+// note : the channel resets itself at its next step (see sdrchstep)
+//-----------------------------------------------------------------------------
+static int dropchannel(void)
+{
+    int i,ntrk=0,drop=-1;
+    double snr,snrmin=0.0;
+    char buffer[MSG_LENGTH];
+
+    mlock(hobsmtx);
+    for (i=0;i<sdrini.nch;i++) {
+        if (!sdrch[i].flagacq||atomget(sdrch[i].task.shed)==SHED_DROP)
+            continue;
+        snr=SNRHIST(&sdrch[i].hist,S,0);
+        if (drop<0||snr<snrmin) {
+            drop=i;
+            snrmin=snr;
+        }
+        ntrk++;
+    }
+    unmlock(hobsmtx);
+
+    if (drop<0||ntrk<=sdrini.shedminch) return 0;
+
+    atomset(sdrch[drop].task.shed,SHED_DROP);
+    sdrshed.ndrop++;
+    snprintf(buffer,sizeof(buffer),
+        "%.3f  shed: dropping G%02d (SNR %.1f, %d tracked)",
+        sdrstat.elapsedTime,sdrch[drop].prn,snrmin,ntrk);
+    add_message(buffer);
+    return 1;
+}
+
+// restore tracking channel ---------------------------------------------------
+// let one dropped channel acquire again
+// args   : none
+// return : none
+//-----------------------------------------------------------------------------
+static void restorechannel(void)
+{
+    int i;
+    char buffer[MSG_LENGTH];
+
+    for (i=0;i<sdrini.nch;i++) {
+        if (atomget(sdrch[i].task.shed)!=SHED_DROP) continue;
+        atomset(sdrch[i].task.shed,SHED_NONE);
+        sdrshed.ndrop--;
+        snprintf(buffer,sizeof(buffer),"%.3f  shed: restoring G%02d",
+            sdrstat.elapsedTime,sdrch[i].prn);
+        add_message(buffer);
+        return;
+    }
+    sdrshed.ndrop=0;
+}
+
+// set shedding level ---------------------------------------------------------
+// args   : int    level     I   new shedding level
+// return : none
+//-----------------------------------------------------------------------------
+static void setlevel(int level)
+{
+    char buffer[MSG_LENGTH];
+
+    if (level==sdrshed.level) return;
+    snprintf(buffer,sizeof(buffer),
+        "%.3f  shed: level %d -> %d (lag %.0f ms, cpu %.0f%%)",
+        sdrstat.elapsedTime,sdrshed.level,level,sdrshed.lagmax,sdrshed.cpu);
+    add_message(buffer);
+
+    // PVT output rate
+    atomset(sdrshed.outms,level>=3?sdrini.shedoutms:sdrini.outms);
+
+    sdrshed.level=level;
+    if (level>sdrshed.maxlevel) sdrshed.maxlevel=level;
+}
+
+// load shedding supervisor thread --------------------------------------------
+// watch the lag of tracking channels and the cpu load and shed load in order
+// when over budget, restore in reverse order when there is headroom
+// args   : void   *arg      I   not used
+// return : none
+// note : levels: 1: suspend acquisition of unlikely PRNs (not predicted
+//        visible or lost lately), 2: drop lowest C/N0 tracking channels
+//        (down to sdrini.shedminch), 3: PVT output interval sdrini.shedoutms.
+//        A level is shed at most every SHEDSETTLE ms and restored after
+//        sdrini.shedhold s below half the lag limit and the cpu limit less
+//        SHEDHYST.
+//-----------------------------------------------------------------------------
+extern void *shedthread(void *arg)
+{
+    cpu_set_t cpus;
+    double tcpu=0.0,twall=0.0,lag;
+    unsigned long tick,tact=0,tfree=0;
+    int i,ncpu,shed,over,under;
+
+    if (sched_getaffinity(0,sizeof(cpu_set_t),&cpus)==-1||
+        (ncpu=CPU_COUNT(&cpus))<1) ncpu=1;
+    cpuload(&tcpu,&twall,ncpu);
+
+    while (!sdrstat.stopflag) {
+        sleepms(SHEDINTV);
+        tick=tickgetus()/1000;
+
+        // max lag of tracking channels (not dropped)
+        sdrshed.cpu=cpuload(&tcpu,&twall,ncpu);
+        for (i=0,sdrshed.lagmax=0.0;i<sdrini.nch;i++) {
+            if (!sdrch[i].flagacq||atomget(sdrch[i].task.shed)==SHED_DROP)
+                continue;
+            lag=sdrch[i].task.lagms;
+            if (lag>sdrshed.lagmax) sdrshed.lagmax=lag;
+        }
+        over=sdrshed.lagmax>sdrini.shedlag||sdrshed.cpu>sdrini.shedcpu;
+        under=sdrshed.lagmax<sdrini.shedlag/2.0&&
+              sdrshed.cpu<sdrini.shedcpu-SHEDHYST;
+
+        // shed one more step (after the last one has settled)
+        if (over) {
+            tfree=0;
+            if (tick-tact>=SHEDSETTLE) {
+                if (sdrshed.level<1) setlevel(1);
+                else if (dropchannel()) setlevel(sdrshed.level>2?3:2);
+                else setlevel(3);
+                tact=tick;
+            }
+        }
+        // restore one step after the headroom held
+        else if (under&&sdrshed.level>0) {
+            if (!tfree) tfree=tick;
+            if (tick-tfree>=(unsigned long)(sdrini.shedhold*1000)) {
+                if (sdrshed.level>=3) {
+                    setlevel(sdrshed.ndrop?2:1);
+                }
+                else if (sdrshed.ndrop) {
+                    restorechannel();
+                    if (!sdrshed.ndrop) setlevel(1);
+                }
+                else setlevel(0);
+                tfree=tick;
+            }
+        }
+        else tfree=0;
+
+        // acquisition of unlikely PRNs (level 1 and above)
+        for (i=0;i<sdrini.nch;i++) {
+            shed=atomget(sdrch[i].task.shed);
+            if (shed==SHED_DROP) continue;
+            shed=sdrshed.level>=1&&!sdrch[i].flagacq&&!acqlikely(&sdrch[i])?
+                 SHED_ACQ:SHED_NONE;
+            atomset(sdrch[i].task.shed,shed);
+        }
+    }
+    return THRETVAL;
+}
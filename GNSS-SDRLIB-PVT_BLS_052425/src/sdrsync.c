@@ -9,26 +9,37 @@
 // synchronization thread for pseudo range computation
 // args   : void   *arg      I   not used
 //* return : none
-// note : this thread collects all data of sdr channel thread and compute pseudo
-//        range at every output timing.
+// note : this thread collects all data of sdr channels and compute pseudo
+//        range at every output timing. It sleeps until a channel updates
+//        the observation data (hobsevent, sdrstat.obscnt).
 //*-----------------------------------------------------------------------------
 extern void *syncthread(void * arg)
 {
     int i,j,nsat,isat[MAXOBS],ind[MAXSAT]={0},refi;
-    uint64_t sampref,sampbase,codei[MAXSAT],diffcnt,mincodei;
+    uint64_t sampref,sampbase,codei[MAXSAT],diffcnt,mincodei,obscnt=0;
+    struct timespec timeout;
     double codeid[OBSINTERPN],remcode[MAXSAT],samprefd,reftow=0,oldreftow;
+    double L[OBSINTERPN],D[OBSINTERPN];
+    double vistow=-ACQVISINTV;
     sdrobs_t obs[MAXSAT];
-    sdrtrk_t trk[MAXSAT]={{0}};
+    sdrtrkhist_t hist[MAXSAT]={{0}};
     int ret=0; // used for function output
     char bufferSync[MSG_LENGTH];
 
     while (!sdrstat.stopflag) {
 
         mlock(hobsmtx);
+         // wait for new observation data   
+        settimeout(&timeout,SAMPWAIT);
+        while (sdrstat.obscnt==obscnt&&!sdrstat.stopflag) {
+            if (timedwaitevent(hobsevent,hobsmtx,&timeout)) break;
+        }
+        obscnt=sdrstat.obscnt;
+
          // copy all tracking data   
         for (i=nsat=0;i<sdrini.nch;i++) {
             if (sdrch[i].nav.flagdec&&sdrch[i].nav.sdreph.eph.week!=0) {
-                memcpy(&trk[nsat],&sdrch[i].trk,sizeof(sdrch[i].trk));
+                memcpy(&hist[nsat],&sdrch[i].hist,sizeof(sdrch[i].hist));
                 isat[nsat]=i;
                 nsat++;
             }
@@ -39,43 +50,47 @@ extern void *syncthread(void * arg)
         oldreftow=reftow;
         reftow=3600*24*7;
         for (i=0;i<nsat;i++) {
-            if (trk[i].tow[0]<reftow)
-                reftow=trk[i].tow[0];
+            if (OBSHIST(&hist[i],tow,0)<reftow)
+                reftow=OBSHIST(&hist[i],tow,0);
         }
          // output timing check   
-        if (nsat==0||oldreftow==reftow||((int)(reftow*1000)%sdrini.outms)!=0) {
+        if (nsat==0||oldreftow==reftow||
+            ((int)(reftow*1000)%atomget(sdrshed.outms))!=0) {
             continue;
         }
          // select same timing index   
         for (i=0;i<nsat;i++) {
             for (j=0;j<OBSINTERPN;j++) {
-                if (fabs(trk[i].tow[j]-reftow)<1E-4) {
+                if (fabs(OBSHIST(&hist[i],tow,j)-reftow)<1E-4) {
                     ind[i]=j;
                     break;
                 }
             }
             if (j==OBSINTERPN-1&&ind[i]==0)
                 SDRPRINTF("error:%s reftow=%.1f tow=%.1f\n",
-                    sdrch[isat[i]].satstr,trk[i].tow[OBSINTERPN-1],reftow);
+                    sdrch[isat[i]].satstr,OBSHIST(&hist[i],tow,OBSINTERPN-1),
+                    reftow);
         }
 
          // decide reference satellite (nearest satellite)   
         mincodei=UINT64_MAX;
         refi=0;
         for (i=0;i<nsat;i++) {
-            codei[i]=trk[i].codei[ind[i]];
-            remcode[i]=trk[i].remcout[ind[i]];
-            if (trk[i].codei[ind[i]]<mincodei) {
+            codei[i]=OBSHIST(&hist[i],codei,ind[i]);
+            remcode[i]=OBSHIST(&hist[i],remcout,ind[i]);
+            if (codei[i]<mincodei) {
                 refi=i;
-                mincodei=trk[i].codei[ind[i]];
+                mincodei=codei[i];
             }
         }
          // reference satellite   
-        diffcnt=trk[refi].cntout[ind[refi]]-sdrch[isat[refi]].nav.firstsfcnt;
+        diffcnt=OBSHIST(&hist[refi],cntout,ind[refi])-
+            sdrch[isat[refi]].nav.firstsfcnt;
         sampref=sdrch[isat[refi]].nav.firstsf+
             (uint64_t)(sdrch[isat[refi]].nsamp*
             (-PTIMING/(1000*sdrch[isat[refi]].ctime)+diffcnt));
-        sampbase=trk[refi].codei[OBSINTERPN-1]-10*sdrch[isat[refi]].nsamp;
+        sampbase=OBSHIST(&hist[refi],codei,OBSINTERPN-1)-
+            10*sdrch[isat[refi]].nsamp;
         samprefd=(double)(sampref-sampbase);
 
          // computation observation data   
@@ -87,11 +102,15 @@ extern void *syncthread(void * arg)
             obs[i].P=CLIGHT*sdrch[isat[i]].ti*
                 ((double)(codei[i]-sampref)-remcode[i]);  // pseudo range   
 
-             // uint64 to double for interp1   
-            uint64todouble(trk[i].codei,sampbase,OBSINTERPN,codeid);
-            obs[i].L=interp1(codeid,trk[i].L,OBSINTERPN,samprefd);
-            obs[i].D=interp1(codeid,trk[i].D,OBSINTERPN,samprefd);
-            obs[i].S=trk[i].S[0];
+             // unwrap history rings (latest first) for interp1   
+            for (j=0;j<OBSINTERPN;j++) {
+                codeid[j]=(double)(OBSHIST(&hist[i],codei,j)-sampbase);
+                L[j]=OBSHIST(&hist[i],L,j);
+                D[j]=OBSHIST(&hist[i],D,j);
+            }
+            obs[i].L=interp1(codeid,L,OBSINTERPN,samprefd);
+            obs[i].D=interp1(codeid,D,OBSINTERPN,samprefd);
+            obs[i].S=SNRHIST(&hist[i],S,0);
         }
 
         // Populate the obs_v vector with the initial obs data and nsat.
@@ -144,6 +163,11 @@ extern void *syncthread(void * arg)
             if (ret != 0) {
               printf("errorDetected: exiting pvtProcessor\n");
             }
+            // Predict visibility for acquisition from almanac
+            else if (sdrini.acqvis && (reftow<vistow ||
+                     reftow-vistow>=ACQVISINTV)) {
+              if (visPredict(reftow)>=0) vistow = reftow;
+            }
         }
         else {
             snprintf(bufferSync, sizeof(bufferSync),
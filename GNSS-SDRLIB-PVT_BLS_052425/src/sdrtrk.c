@@ -7,31 +7,52 @@
 #include "sdr.h"
 
 /* sdr tracking function -------------------------------------------------------
-* sdr tracking function called from sdr channel thread
+* sdr tracking function called from the channel step (sdrchstep)
 * args   : sdrch_t *sdr      I/O sdr channel struct
 *          uint64_t buffloc  I   buffer location
 *          uint64_t cnt      I   counter of sdr channel thread
 * return : uint64_t              current buffer location
+* notes  : sampling data are read in place from the memory buffer if possible
+*          (rcvviewbuff), else copied to the channel scratch buffer. Correlator
+*          work arrays are the channel scratch buffers (sdr->buf), no
+*          sdrmalloc/cpxmalloc call in steady state (counted in sdr->buf.nalloc)
+*          if the samples were overwritten by the grabber before or while they
+*          were read (channel more than MEMBUFFLEN buffers behind), the step is
+*          dropped and sdr->task.overrun is set
+*          if the code period exceeds the scratch buffers (sdr->buf.nmax), the
+*          code loop has diverged: the step is dropped and sdr->task.lostlock
+*          is set
 *-----------------------------------------------------------------------------*/
 extern uint64_t sdrtracking(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt)
 {
-    char *data=NULL;
+    const char *data;
     uint64_t bufflocnow;
+    unsigned long nalloc=sdrnalloc();
 
     sdr->flagtrk=OFF;
 
-    /* memory allocation */
-    data=(char*)sdrmalloc(sizeof(char)*(sdr->nsamp+100)*sdr->dtype);
-
     /* current buffer location */
-    mlock(hreadmtx);
-    bufflocnow=sdrstat.fendbuffsize*sdrstat.buffcnt-sdr->nsamp;
-    unmlock(hreadmtx);
+    bufflocnow=sdrstat.fendbuffsize*rcvbuffcnt()-sdr->nsamp;
 
     if (bufflocnow>buffloc) {
+        /* samples already overwritten (ring overrun) */
+        if (!rcvcheckbuff(buffloc)) {
+            sdr->task.overrun=ON;
+            return bufflocnow;
+        }
         sdr->currnsamp=(int)((sdr->clen-sdr->trk.remcode)/
             (sdr->trk.codefreq/sdr->f_sf));
-        rcvgetbuff(&sdrini,buffloc,sdr->currnsamp,sdr->ftype,sdr->dtype,data);
+        /* code loop diverged (loss of lock) */
+        if (sdr->currnsamp<=0||sdr->currnsamp>sdr->buf.nmax) {
+            sdr->task.lostlock=ON;
+            return bufflocnow;
+        }
+        data=rcvviewbuff(&sdrini,buffloc,sdr->currnsamp,sdr->ftype,sdr->dtype);
+        if (!data) {
+            rcvgetbuff(&sdrini,buffloc,sdr->currnsamp,sdr->ftype,sdr->dtype,
+                sdr->buf.data);
+            data=sdr->buf.data;
+        }
 
         /*
         int ctr;
@@ -43,8 +64,8 @@ extern uint64_t sdrtracking(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt)
         ctr = ctr + 1;
         */
 
-        memcpy(sdr->trk.oldI,sdr->trk.II,1+2*sdr->trk.corrn*sizeof(double));
-        memcpy(sdr->trk.oldQ,sdr->trk.QQ,1+2*sdr->trk.corrn*sizeof(double));
+        memcpy(sdr->trk.oldI,sdr->trk.II,(1+2*sdr->trk.corrn)*sizeof(double));
+        memcpy(sdr->trk.oldQ,sdr->trk.QQ,(1+2*sdr->trk.corrn)*sizeof(double));
         sdr->trk.oldremcode=sdr->trk.remcode;
         sdr->trk.oldremcarr=sdr->trk.remcarr;
 
@@ -52,16 +73,28 @@ extern uint64_t sdrtracking(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt)
         correlator(data,sdr->dtype,sdr->ti,sdr->currnsamp,sdr->trk.carrfreq,
             sdr->trk.oldremcarr,sdr->trk.codefreq, sdr->trk.oldremcode,
             sdr->trk.corrp,sdr->trk.corrn,sdr->trk.QQ,sdr->trk.II,
-            &sdr->trk.remcode,&sdr->trk.remcarr,sdr->code,sdr->clen);
-
+            &sdr->trk.remcode,&sdr->trk.remcarr,sdr->code,sdr->clen,
+            sdr->buf.dataI,sdr->buf.dataQ,sdr->buf.code,&sdr->cbank);
+
+        /* samples overwritten while they were read (ring overrun): back to
+           the loop state at buffloc (see trkresync) */
+        if (!rcvcheckbuff(buffloc)) {
+            sdr->trk.remcode=sdr->trk.oldremcode;
+            sdr->trk.remcarr=sdr->trk.oldremcarr;
+            memcpy(sdr->trk.II,sdr->trk.oldI,
+                (1+2*sdr->trk.corrn)*sizeof(double));
+            memcpy(sdr->trk.QQ,sdr->trk.oldQ,
+                (1+2*sdr->trk.corrn)*sizeof(double));
+            sdr->task.overrun=ON;
+            return bufflocnow;
+        }
         /* navigation data */
         sdrnavigation(sdr,buffloc,cnt);
 
         sdr->flagtrk=ON;
-    } else {
-        sleepms(1);
     }
-    sdrfree(data);
+    /* sdrmalloc/cpxmalloc calls in this epoch (zero in steady state) */
+    sdr->buf.nalloc+=sdrnalloc()-nalloc;
     return bufflocnow;
 }
 
@@ -180,36 +213,39 @@ extern void dll(sdrch_t *sdr, sdrtrkprm_t *prm, double dt)
 *          sdrtrk_t trk     I/0 sdr tracking struct
 *          int    snrflag   I   SNR calculation flag
 * return : none
+* notes  : observation histories (sdr->hist) are rings of OBSINTERPN entries,
+*          a new entry is pushed by moving the head back (see OBSHIST/SNRHIST)
 *-----------------------------------------------------------------------------*/
 extern void setobsdata(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt,
                        sdrtrk_t *trk, int snrflag)
 {
-    shiftdata(&trk->tow[1],&trk->tow[0],sizeof(double),OBSINTERPN-1);
-    shiftdata(&trk->L[1],&trk->L[0],sizeof(double),OBSINTERPN-1);
-    shiftdata(&trk->D[1],&trk->D[0],sizeof(double),OBSINTERPN-1);
-    shiftdata(&trk->codei[1],&trk->codei[0],sizeof(uint64_t),OBSINTERPN-1);
-    shiftdata(&trk->cntout[1],&trk->cntout[0],sizeof(uint64_t),OBSINTERPN-1);
-    shiftdata(&trk->remcout[1],&trk->remcout[0],sizeof(double),OBSINTERPN-1);
-
-    trk->tow[0]=sdr->nav.firstsftow+
+    sdrtrkhist_t *hist=&sdr->hist;
+    double *L;
+
+    /* push new entry (carrier phase continues from the latest) */
+    hist->obsi=(hist->obsi+OBSINTERPN-1)%OBSINTERPN;
+    L=&OBSHIST(hist,L,0);
+    *L=OBSHIST(hist,L,1);
+
+    OBSHIST(hist,tow,0)=sdr->nav.firstsftow+
         (double)(cnt-sdr->nav.firstsfcnt)*sdr->ctime;
-    trk->codei[0]=buffloc;
-    trk->cntout[0]=cnt;
-    trk->remcout[0]=trk->oldremcode*sdr->f_sf/trk->codefreq;
+    OBSHIST(hist,codei,0)=buffloc;
+    OBSHIST(hist,cntout,0)=cnt;
+    OBSHIST(hist,remcout,0)=trk->oldremcode*sdr->f_sf/trk->codefreq;
 
     /* doppler */
-    trk->D[0]=-(trk->carrfreq-sdr->f_if-sdr->foffset);
+    OBSHIST(hist,D,0)=-(trk->carrfreq-sdr->f_if-sdr->foffset);
 
     /* carrier phase */
     if (!trk->flagremcarradd) {
-        trk->L[0]-=trk->remcarr/DPI;
+        *L-=trk->remcarr/DPI;
         //SDRPRINTF("%s cnt=%llu inicarrier=%f m\n",sdr->satstr,cnt,CLIGHT/FREQ1*trk->remcarr/DPI);
         trk->flagremcarradd=ON;
     }
 
     if (sdr->nav.flagsyncf&&!trk->flagpolarityadd) {
         if (sdr->nav.polarity==1) {
-            trk->L[0]+=0.5;
+            *L+=0.5;
             //SDRPRINTF("%s cnt=%llu polarity=0.5\n",sdr->satstr,cnt);
         } else {
             //SDRPRINTF("%s cnt=%llu polarity=0.0\n",sdr->satstr,cnt);
@@ -217,17 +253,74 @@ extern void setobsdata(sdrch_t *sdr, uint64_t buffloc, uint64_t cnt,
         trk->flagpolarityadd=ON;
     }
 
-    trk->L[0]+=trk->D[0]*(trk->loopms*sdr->currnsamp/sdr->f_sf);
+    *L+=OBSHIST(hist,D,0)*(trk->loopms*sdr->currnsamp/sdr->f_sf);
 
     trk->Isum+=fabs(trk->sumI[0]);
     if (snrflag) {
-        shiftdata(&trk->S[1],&trk->S[0],sizeof(double),OBSINTERPN-1);
-        shiftdata(&trk->codeisum[1],&trk->codeisum[0],
-            sizeof(uint64_t),OBSINTERPN-1);
+        hist->snri=(hist->snri+OBSINTERPN-1)%OBSINTERPN;
 
         /* signal to noise ratio */
-        trk->S[0]=10*log(trk->Isum/100.0/100.0)+log(500.0)+5;
-        trk->codeisum[0]=buffloc;
+        SNRHIST(hist,S,0)=10*log(trk->Isum/100.0/100.0)+log(500.0)+5;
+        SNRHIST(hist,codeisum,0)=buffloc;
         trk->Isum=0;
     }
 }
+/* resynchronize tracking after ring overrun -----------------------------------
+* skip the overwritten samples: advance the buffer location by a whole number
+* of code periods to the current producer position, keeping the code and
+* carrier frequencies of the loop, so that the channel goes on tracking
+* args   : sdrch_t *sdr     I/O sdr channel struct
+*          uint64_t buffloc I   buffer location of the overwritten code
+*          uint64_t *cnt    I/O counter of sdr channel thread
+* return : uint64_t             buffer location of next code (0: not possible)
+* notes  : code and carrier phase are propagated over the skipped samples and
+*          the counter is advanced by the skipped codes, so that bit and frame
+*          timing (tow) are kept. the frame bit ring is advanced by the skipped
+*          bits (frames over the gap fail parity and are not decoded)
+*          call with hobsmtx locked (observation history)
+*          built with -DTEST_OVRAIDED, no resync is done, so that the overrun
+*          test (gnss-sdrlib-pvt -overrun) checks the aided reacquisition
+*-----------------------------------------------------------------------------*/
+extern uint64_t trkresync(sdrch_t *sdr, uint64_t buffloc, uint64_t *cnt)
+{
+    sdrtrk_t *trk=&sdr->trk;
+    sdrnav_t *nav=&sdr->nav;
+    uint64_t loc,n,a,s;
+    double tcode,x,r;
+
+#if defined(TEST_OVRAIDED)
+    return 0;
+#endif
+
+    if (trk->codefreq<=0.0) return 0;
+
+    /* code period (sample) */
+    tcode=sdr->f_sf*sdr->clen/trk->codefreq;
+    if (tcode<1.0||tcode>sdr->buf.nmax) return 0;
+
+    /* latest code received (see sdrtracking) */
+    loc=sdrstat.fendbuffsize*rcvbuffcnt()-sdr->nsamp;
+    if (loc<=buffloc) return 0;
+
+    /* whole code periods to skip */
+    n=(uint64_t)ceil((loc-buffloc)/tcode);
+    x=(double)buffloc+n*tcode;
+    loc=(uint64_t)ceil(x);
+
+    /* code phase at first sample, carrier phase over skipped samples */
+    trk->remcode+=(loc-x)*trk->codefreq/sdr->f_sf;
+    r=trk->remcarr+DPI*trk->carrfreq*(loc-buffloc)/sdr->f_sf;
+    trk->remcarr=r-floor(r/DPI)*DPI;
+
+    /* frame bits of skipped codes (bit is set at cnt%rate==synci) */
+    if (nav->flagsync&&nav->rate>0) {
+        a=*cnt+nav->rate-nav->synci;
+        s=(a+n-1)/nav->rate-(a-1)/nav->rate;
+        nav->fbitsi=(int)((nav->fbitsi+s)%(nav->flen+nav->addflen));
+    }
+    /* carrier phase continues over the gap */
+    OBSHIST(&sdr->hist,L,0)+=OBSHIST(&sdr->hist,D,0)*(loc-buffloc)/sdr->f_sf;
+
+    *cnt+=n;
+    return loc;
+}